@@ -14,7 +14,7 @@ import os
 
 from .errors import LoomError, LoomException, TaskFailed  # noqa
 
-LOOM_PROTOCOL_VERSION = 2
+LOOM_PROTOCOL_VERSION = 6
 
 
 class Client(object):
@@ -34,6 +34,7 @@ class Client(object):
         self.symbols = None
         self.array_id = None
         self.rawdata_id = None
+        self.file_id = None
 
         self.submit_id = 0
         self.futures = {}
@@ -60,9 +61,17 @@ class Client(object):
         cmsg = ClientResponse()
         cmsg.ParseFromString(msg)
         assert cmsg.type == ClientResponse.STATS
+        task_types = {}
+        for s in cmsg.stats.task_types:
+            task_types[s.task_type] = {
+                "n_samples": s.n_samples,
+                "duration": s.duration,
+                "size": s.size
+            }
         return {
             "n_workers": cmsg.stats.n_workers,
-            "n_data_objects": cmsg.stats.n_data_objects
+            "n_data_objects": cmsg.stats.n_data_objects,
+            "task_types": task_types
         }
 
     def close(self):
@@ -320,6 +329,7 @@ class Client(object):
             self.symbols[s] = i
         self.array_id = self.symbols.get("loom/array")
         self.rawdata_id = self.symbols.get("loom/data")
+        self.file_id = self.symbols.get("loom/file")
         self.pyobj_id = self.symbols.get("loom/pyobj")
 
     def process_task_failed(self, cmsg):
@@ -333,7 +343,7 @@ class Client(object):
         raise LoomError(error.error_msg)
 
     def _receive_data(self, type_id):
-        if type_id == self.rawdata_id:
+        if type_id == self.rawdata_id or type_id == self.file_id:
             return self.connection.receive_message()
         if type_id == self.array_id:
             types = self.connection.receive_message()
@@ -49,6 +49,14 @@ class Task:
             return self.task_type
 
 
+def _object_size(line):
+    # Size of the data object; sent bytes differ for compressed data.
+    # Older traces have only the number of sent bytes
+    if len(line) > 4:
+        return to_int(line[4])
+    return to_int(line[2])
+
+
 def _get_task(tasks, task_id):
     task = tasks.get(task_id)
     if task is not None:
@@ -200,7 +208,8 @@ class Report:
                         w = w.worker_id
                     else:
                         w = -1
-                    sends.append((time, to_int(line[1]), to_int(line[2]), w))
+                    sends.append((time, to_int(line[1]), to_int(line[2]), w,
+                                  _object_size(line)))
                 elif command == "R":
                     w = self.workers_by_addr.get(line[3])
                     if w is not None:
@@ -208,11 +217,12 @@ class Report:
                     else:
                         w = -1
                         print("WARNING! Received data from dummy worker.")
-                    recvs.append((time, to_int(line[1]), to_int(line[2]), w))
+                    recvs.append((time, to_int(line[1]), to_int(line[2]), w,
+                                  _object_size(line)))
                 else:
                     raise Exception("Unknown line: {}".format(line))
 
-            columns = ("time", "id", "data_size", "peer_id")
+            columns = ("time", "id", "data_size", "peer_id", "object_size")
             worker.sends = pd.DataFrame(sends, columns=columns)
             worker.recvs = pd.DataFrame(recvs, columns=columns)
             worker.monitoring = pd.DataFrame({"time": monitoring_times,
@@ -0,0 +1,70 @@
+# -*- coding: utf-8 -*-
+# Generated by the protocol buffer compiler.  DO NOT EDIT!
+# source: comm.proto
+"""Generated protocol buffer code."""
+from google.protobuf.internal import builder as _builder
+from google.protobuf import descriptor as _descriptor
+from google.protobuf import descriptor_pool as _descriptor_pool
+from google.protobuf import symbol_database as _symbol_database
+# @@protoc_insertion_point(imports)
+
+_sym_db = _symbol_database.Default()
+
+
+
+
+DESCRIPTOR = _descriptor_pool.Default().AddSerializedFile(b'\n\ncomm.proto\x12\x0cloom.pb.comm\"\xaa\x01\n\x04Task\x12\x11\n\ttask_type\x18\x01 \x02(\x05\x12\x0e\n\x06\x63onfig\x18\x02 \x02(\x0c\x12\x11\n\tinput_ids\x18\x03 \x03(\x05\x12\"\n\x16resource_request_index\x18\x05 \x01(\x05:\x02-1\x12\x0e\n\x06result\x18\x06 \x01(\x08\x12\x17\n\x0f\x63heckpoint_path\x18\x07 \x01(\t\x12\r\n\x05label\x18\x0c \x01(\t\x12\x10\n\x08metadata\x18\r \x01(\x0c\"0\n\x08Resource\x12\x15\n\rresource_type\x18\x01 \x02(\x05\x12\r\n\x05value\x18\x02 \x02(\x05\"<\n\x0fResourceRequest\x12)\n\tresources\x18\x01 \x03(\x0b\x32\x16.loom.pb.comm.Resource\"t\n\x04Plan\x12\x38\n\x11resource_requests\x18\x01 \x03(\x0b\x32\x1d.loom.pb.comm.ResourceRequest\x12!\n\x05tasks\x18\x02 \x03(\x0b\x32\x12.loom.pb.comm.Task\x12\x0f\n\x07id_base\x18\x04 \x01(\x05\"\xc5\x01\n\x08Register\x12\x18\n\x10protocol_version\x18\x01 \x02(\x05\x12)\n\x04type\x18\x02 \x02(\x0e\x32\x1b.loom.pb.comm.Register.Type\x12\x0c\n\x04port\x18\x03 \x01(\x05\x12\x12\n\ntask_types\x18\x04 \x03(\t\x12\x12\n\ndata_types\x18\x05 \x03(\t\x12\x0c\n\x04\x63pus\x18\x06 \x01(\x05\"0\n\x04Type\x12\x13\n\x0fREGISTER_WORKER\x10\x01\x12\x13\n\x0fREGISTER_CLIENT\x10\x02\"&\n\rServerMessage\"\x15\n\x04Type\x12\r\n\tSTART_JOB\x10\x01\"\xe5\x02\n\rWorkerCommand\x12.\n\x04type\x18\x01 \x02(\x0e\x32 .loom.pb.comm.WorkerCommand.Type\x12\n\n\x02id\x18\x02 \x01(\x05\x12\x11\n\ttask_type\x18\x03 \x01(\x05\x12\x13\n\x0btask_config\x18\x04 \x01(\t\x12\x13\n\x0btask_inputs\x18\x05 \x03(\x05\x12\x0e\n\x06n_cpus\x18\x06 \x01(\x05\x12\x17\n\x0f\x63heckpoint_path\x18\x07 \x01(\t\x12\x0f\n\x07\x61\x64\x64ress\x18\n \x01(\t\x12\x10\n\x08priority\x18\x0b \x01(\x03\x12\x0f\n\x07symbols\x18\x64 \x03(\t\x12\x12\n\ntrace_path\x18x \x01(\t\x12\x11\n\tworker_id\x18y \x01(\x05\"W\n\x04Type\x12\x08\n\x04TASK\x10\x01\x12\x08\n\x04SEND\x10\x02\x12\n\n\x06REMOVE\x10\x03\x12\x0e\n\nDICTIONARY\x10\x08\x12\n\n\x06UPDATE\x10\t\x12\x13\n\x0fLOAD_CHECKPOINT\x10\n\"C\n\x12WorkerCommandBatch\x12-\n\x08\x63ommands\x18\x01 \x03(\x0b\x32\x1b.loom.pb.comm.WorkerCommand\"\xb9\x02\n\x0eWorkerResponse\x12/\n\x04type\x18\x01 \x02(\x0e\x32!.loom.pb.comm.WorkerResponse.Type\x12\n\n\x02id\x18\x02 \x02(\x05\x12\x0c\n\x04size\x18\x03 \x01(\x04\x12\x0e\n\x06length\x18\x04 \x01(\x04\x12\x11\n\terror_msg\x18\x64 \x01(\t\"\xb8\x01\n\x04Type\x12\x0c\n\x08\x46INISHED\x10\x01\x12\x1e\n\x1a\x46INISHED_AND_CHECKPOINTING\x10\x02\x12\x0e\n\nTRANSFERED\x10\x03\x12\n\n\x06\x46\x41ILED\x10\x04\x12\x16\n\x12\x43HECKPOINT_WRITTEN\x10\x05\x12\x1b\n\x17\x43HECKPOINT_WRITE_FAILED\x10\x06\x12\x15\n\x11\x43HECKPOINT_LOADED\x10\x07\x12\x1a\n\x16\x43HECKPOINT_LOAD_FAILED\x10\x08\"F\n\x13WorkerResponseBatch\x12/\n\tresponses\x18\x01 \x03(\x0b\x32\x1c.loom.pb.comm.WorkerResponse\"P\n\x08\x41nnounce\x12\x0c\n\x04port\x18\x01 \x02(\x05\x12\x0f\n\x07host_id\x18\x02 \x01(\t\x12\x10\n\x08work_dir\x18\x03 \x01(\t\x12\x13\n\x0b\x63ompression\x18\x04 \x01(\x08\"j\n\nDataHeader\x12\n\n\x02id\x18\x01 \x02(\x05\x12\x0f\n\x07type_id\x18\x03 \x02(\x05\x12\x12\n\nn_messages\x18\x02 \x02(\x03\x12\x10\n\x08\x66ilename\x18\x04 \x01(\t\x12\x19\n\x11uncompressed_size\x18\x05 \x01(\x03\"6\n\x05\x45rror\x12\n\n\x02id\x18\x01 \x01(\x05\x12\x0e\n\x06worker\x18\x02 \x01(\t\x12\x11\n\terror_msg\x18\x03 \x01(\t\"U\n\rTaskTypeStats\x12\x11\n\ttask_type\x18\x01 \x02(\t\x12\x11\n\tn_samples\x18\x02 \x02(\x03\x12\x10\n\x08\x64uration\x18\x03 \x02(\x01\x12\x0c\n\x04size\x18\x04 \x02(\x01\"c\n\x05Stats\x12\x11\n\tn_workers\x18\x01 \x01(\x05\x12\x16\n\x0en_data_objects\x18\x02 \x01(\x05\x12/\n\ntask_types\x18\x03 \x03(\x0b\x32\x1b.loom.pb.comm.TaskTypeStats\"\xaa\x02\n\x0e\x43lientResponse\x12/\n\x04type\x18\x01 \x02(\x0e\x32!.loom.pb.comm.ClientResponse.Type\x12&\n\x04\x64\x61ta\x18\x02 \x01(\x0b\x32\x18.loom.pb.comm.DataHeader\x12\"\n\x05\x65rror\x18\x04 \x01(\x0b\x32\x13.loom.pb.comm.Error\x12\x0f\n\x07symbols\x18\x05 \x03(\t\x12\"\n\x05stats\x18\x06 \x01(\x0b\x32\x13.loom.pb.comm.Stats\x12\n\n\x02id\x18\x07 \x01(\x05\"Z\n\x04Type\x12\x08\n\x04\x44\x41TA\x10\x01\x12\x11\n\rTASK_FINISHED\x10\x02\x12\x0f\n\x0bTASK_FAILED\x10\x03\x12\t\n\x05\x45RROR\x10\x04\x12\x0e\n\nDICTIONARY\x10\n\x12\t\n\x05STATS\x10\x0b\"\xea\x01\n\rClientRequest\x12.\n\x04type\x18\x01 \x02(\x0e\x32 .loom.pb.comm.ClientRequest.Type\x12 \n\x04plan\x18\x02 \x01(\x0b\x32\x12.loom.pb.comm.Plan\x12\x18\n\x10load_checkpoints\x18\x04 \x01(\x08\x12\n\n\x02id\x18\x03 \x01(\x05\x12\x12\n\ntrace_path\x18\x07 \x01(\t\"M\n\x04Type\x12\x08\n\x04PLAN\x10\x01\x12\t\n\x05\x46\x45TCH\x10\x02\x12\x0b\n\x07RELEASE\x10\x03\x12\t\n\x05STATS\x10\x06\x12\t\n\x05TRACE\x10\x07\x12\r\n\tTERMINATE\x10\nB\x02H\x03')
+
+_builder.BuildMessageAndEnumDescriptors(DESCRIPTOR, globals())
+_builder.BuildTopDescriptorsAndMessages(DESCRIPTOR, 'comm_pb2', globals())
+if _descriptor._USE_C_DESCRIPTORS == False:
+
+  DESCRIPTOR._options = None
+  DESCRIPTOR._serialized_options = b'H\003'
+  _TASK._serialized_start=29
+  _TASK._serialized_end=199
+  _RESOURCE._serialized_start=201
+  _RESOURCE._serialized_end=249
+  _RESOURCEREQUEST._serialized_start=251
+  _RESOURCEREQUEST._serialized_end=311
+  _PLAN._serialized_start=313
+  _PLAN._serialized_end=429
+  _REGISTER._serialized_start=432
+  _REGISTER._serialized_end=629
+  _REGISTER_TYPE._serialized_start=581
+  _REGISTER_TYPE._serialized_end=629
+  _SERVERMESSAGE._serialized_start=631
+  _SERVERMESSAGE._serialized_end=669
+  _SERVERMESSAGE_TYPE._serialized_start=648
+  _SERVERMESSAGE_TYPE._serialized_end=669
+  _WORKERCOMMAND._serialized_start=672
+  _WORKERCOMMAND._serialized_end=1029
+  _WORKERCOMMAND_TYPE._serialized_start=942
+  _WORKERCOMMAND_TYPE._serialized_end=1029
+  _WORKERCOMMANDBATCH._serialized_start=1031
+  _WORKERCOMMANDBATCH._serialized_end=1098
+  _WORKERRESPONSE._serialized_start=1101
+  _WORKERRESPONSE._serialized_end=1414
+  _WORKERRESPONSE_TYPE._serialized_start=1230
+  _WORKERRESPONSE_TYPE._serialized_end=1414
+  _WORKERRESPONSEBATCH._serialized_start=1416
+  _WORKERRESPONSEBATCH._serialized_end=1486
+  _ANNOUNCE._serialized_start=1488
+  _ANNOUNCE._serialized_end=1568
+  _DATAHEADER._serialized_start=1570
+  _DATAHEADER._serialized_end=1676
+  _ERROR._serialized_start=1678
+  _ERROR._serialized_end=1732
+  _TASKTYPESTATS._serialized_start=1734
+  _TASKTYPESTATS._serialized_end=1819
+  _STATS._serialized_start=1821
+  _STATS._serialized_end=1920
+  _CLIENTRESPONSE._serialized_start=1923
+  _CLIENTRESPONSE._serialized_end=2221
+  _CLIENTRESPONSE_TYPE._serialized_start=2131
+  _CLIENTRESPONSE_TYPE._serialized_end=2221
+  _CLIENTREQUEST._serialized_start=2224
+  _CLIENTREQUEST._serialized_end=2458
+  _CLIENTREQUEST_TYPE._serialized_start=2381
+  _CLIENTREQUEST_TYPE._serialized_end=2458
+# @@protoc_insertion_point(module_scope)
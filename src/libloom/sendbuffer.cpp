@@ -1,6 +1,11 @@
 #include "sendbuffer.h"
 
 #include "compat.h"
+#include "log.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace loom::base;
 
@@ -9,6 +14,13 @@ SendBuffer::SendBuffer()
     request.data = this;
 }
 
+SendBuffer::~SendBuffer()
+{
+    if (on_finish) {
+        on_finish();
+    }
+}
+
 size_t SendBuffer::get_data_size() const
 {
     size_t result = 0;
@@ -19,6 +31,16 @@ size_t SendBuffer::get_data_size() const
     return result;
 }
 
+bool SendBuffer::has_file_items() const
+{
+    for (auto& item : items) {
+        if (item->get_fd() >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 std::vector<uv_buf_t> loom::base::SendBuffer::get_bufs()
 {
    std::vector<uv_buf_t> bufs;
@@ -47,6 +69,12 @@ uv_buf_t MemItem::get_buf()
    return buf;
 }
 
+void MemItem::truncate(size_t new_size)
+{
+   assert(new_size <= size);
+   size = new_size;
+}
+
 SendBufferItem::~SendBufferItem()
 {
 
@@ -71,3 +99,25 @@ uv_buf_t MemItemWithSz::get_buf()
    buf.len = size;
    return buf;
 }
+
+FileItem::FileItem(const std::string &filename, size_t size) : size(size)
+{
+   fd = ::open(filename.c_str(), O_RDONLY);
+   if (fd < 0) {
+      logger->critical("Cannot open {} for sending", filename);
+      log_errno_abort("open");
+   }
+}
+
+FileItem::~FileItem()
+{
+   ::close(fd);
+}
+
+uv_buf_t FileItem::get_buf()
+{
+   uv_buf_t buf;
+   buf.base = nullptr;
+   buf.len = size;
+   return buf;
+}
@@ -4,7 +4,9 @@
 #include "types.h"
 
 #include <uv.h>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace loom {
@@ -15,6 +17,12 @@ class SendBufferItem {
 public:
    virtual ~SendBufferItem();
    virtual uv_buf_t get_buf() = 0;
+
+   /** Descriptor of a file whose content is sent instead of memory
+    *  (see FileItem), -1 for items in memory */
+   virtual int get_fd() const {
+      return -1;
+   }
 };
 
 
@@ -28,6 +36,9 @@ public:
       return mem.get();
    }
 
+   /** Only the first new_size bytes are sent */
+   void truncate(size_t new_size);
+
 private:
    std::unique_ptr<char[]> mem;
    size_t size;
@@ -65,6 +76,23 @@ protected:
    T value;
 };
 
+/** Content of a file; it is sent by sendfile(2) directly from the page cache,
+ *  get_buf() returns only its size */
+class FileItem : public SendBufferItem {
+
+public:
+   FileItem(const std::string &filename, size_t size);
+   ~FileItem();
+   uv_buf_t get_buf();
+   int get_fd() const {
+      return fd;
+   }
+
+private:
+   int fd;
+   size_t size;
+};
+
 using SizeBufferItem = PODItem<uint64_t>;
 using IdBufferItem = PODItem<Id>;
 
@@ -74,6 +102,7 @@ class SendBuffer {
 public:
 
     SendBuffer();
+    ~SendBuffer();
 
     uv_write_t* get_request() {
         return &request;
@@ -91,13 +120,26 @@ public:
        return items.size();
     }
 
+    SendBufferItem& get_item(size_t index) {
+       return *items[index];
+    }
+
+    bool has_file_items() const;
+
     size_t get_data_size() const;
 
     std::vector<uv_buf_t> get_bufs();
 
+    /** Callback is called when the buffer is released, i.e. when it was
+     *  written or when the socket was closed before */
+    void set_on_finish(std::function<void()> &&on_finish) {
+        this->on_finish = std::move(on_finish);
+    }
+
 protected:
     uv_write_t request;
     std::vector<std::unique_ptr<SendBufferItem>> items;
+    std::function<void()> on_finish;
 };
 
 }}
@@ -4,15 +4,43 @@
 #include "libloom/compat.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
 
 using namespace loom::base;
 
+static const size_t READ_BUFFER_SIZE = 64 << 10; // 64 kB
+static const size_t STREAM_READ_SIZE = 8 << 20; // 8 MB
+static const int SENDFILE_POLL_TIMEOUT = 100; // ms
+
 Socket::Socket(uv_loop_t *loop)
-   : state(State::New), stream_mode(false), stream_remaining(0)
+   : state(State::New),
+     read_capacity(0),
+     read_begin(0),
+     read_end(0),
+     stream_mode(false),
+     stream_remaining(0),
+     stream_target(nullptr),
+     send_position(0),
+     n_writes(0),
+     queue_write_active(false),
+     sendfile_active(false),
+     sendfile_cancel(false),
+     queued_bytes(0),
+     high_watermark(SIZE_MAX),
+     low_watermark(0),
+     congested(false)
 {
     UV_CHECK(uv_tcp_init(loop, &uv_socket));
     UV_CHECK(uv_tcp_nodelay(&uv_socket, 1));
     uv_socket.data = this;
+    queue_write.data = this;
+    sendfile_work.data = this;
 
     on_error = [](int status) {
         assert(status);
@@ -29,17 +57,30 @@ void Socket::close()
 {
     if (state != State::Closed && state != State::Closing) {
         state = State::Closing;
-        uv_close((uv_handle_t*) &uv_socket, [](uv_handle_t *handle) {
-            auto *socket = static_cast<Socket *>(handle->data);
-            socket->state = State::Closed;
-            socket->on_close();
-        });
+        if (!sendfile_active) {
+            close_handle();
+        } else {
+            // The handle is closed when the sendfile job returns,
+            // its thread still uses the descriptor
+            sendfile_cancel = true;
+        }
     }
 }
 
+void Socket::close_handle()
+{
+    uv_close((uv_handle_t*) &uv_socket, [](uv_handle_t *handle) {
+        auto *socket = static_cast<Socket *>(handle->data);
+        socket->send_queue.clear();
+        socket->state = State::Closed;
+        socket->on_close();
+    });
+}
+
 void Socket::close_and_discard_remaining_data()
 {
-    buffer.clear();
+    read_begin = read_end = 0;
+    stream_target = nullptr;
     uv_read_stop((uv_stream_t*) &uv_socket);
     close();
 }
@@ -71,6 +112,7 @@ void Socket::connect(const std::string &host, int port)
                  } else {
                      socket->state = State::Open;
                      uv_read_start((uv_stream_t *)&socket->uv_socket, _buf_alloc, _on_read);
+                     socket->send_queued();
                      socket->on_connect();
                  }                
              }));
@@ -87,28 +129,220 @@ std::string Socket::get_peername() const
 }
 
 void Socket::send(std::unique_ptr<SendBuffer> buffer)
-{    
+{
+    queued_bytes += buffer->get_data_size();
+    if (queued_bytes >= high_watermark) {
+        congested = true;
+    }
+
+    if (!send_queue.empty() || buffer->has_file_items()) {
+        send_queue.push_back(std::move(buffer));
+        send_queued();
+        return;
+    }
     auto bufs = buffer->get_bufs();
     SendBuffer *b = buffer.release();
-    UV_CHECK(uv_write(b->get_request(), (uv_stream_t *) &uv_socket, &bufs[0], bufs.size(),
-                      [](uv_write_t *write_req, int status){
-                 UV_CHECK(status);
-                 SendBuffer *buffer = static_cast<SendBuffer *>(write_req->data);
-                 delete buffer;
-             }));
+    n_writes++;
+    UV_CHECK(uv_write(b->get_request(), (uv_stream_t *) &uv_socket, &bufs[0], bufs.size(), _on_write));
+}
+
+void Socket::_on_write(uv_write_t *write_req, int status)
+{
+    UV_CHECK(status);
+    SendBuffer *buffer = static_cast<SendBuffer *>(write_req->data);
+    size_t size = buffer->get_data_size();
+    delete buffer;
+    Socket *socket = static_cast<Socket*>(write_req->handle->data);
+    socket->n_writes--;
+    socket->written(size);
+    if (!socket->send_queue.empty()) {
+        socket->send_queued();
+    }
+}
+
+void Socket::written(size_t size)
+{
+    assert(queued_bytes >= size);
+    queued_bytes -= size;
+    if (congested && queued_bytes <= low_watermark) {
+        congested = false;
+        if (on_drain) {
+            on_drain();
+        }
+    }
+}
+
+void Socket::send_queued()
+{
+    while (!send_queue.empty() && !queue_write_active && !sendfile_active) {
+        if (state != State::Open) {
+            // Started again when connected
+            return;
+        }
+        SendBuffer &buffer = *send_queue.front();
+        if (send_position == buffer.get_size()) {
+            send_queue.pop_front();
+            send_position = 0;
+            continue;
+        }
+
+        SendBufferItem &item = buffer.get_item(send_position);
+        if (item.get_fd() >= 0) {
+            if (n_writes) {
+                // Sendfile has to wait for all previous writes
+                return;
+            }
+            send_position++;
+            sendfile_active = true;
+            sendfile_fd = item.get_fd();
+            sendfile_size = item.get_buf().len;
+            sendfile_offset = 0;
+            sendfile_error = 0;
+            UV_CHECK(uv_queue_work(uv_socket.loop, &sendfile_work, _sendfile_work, _after_sendfile));
+            return;
+        }
+
+        std::vector<uv_buf_t> bufs;
+        queue_write_size = 0;
+        while (send_position < buffer.get_size() &&
+               buffer.get_item(send_position).get_fd() < 0) {
+            uv_buf_t buf = buffer.get_item(send_position).get_buf();
+            bufs.push_back(buf);
+            queue_write_size += buf.len;
+            send_position++;
+        }
+        queue_write_active = true;
+        n_writes++;
+        UV_CHECK(uv_write(&queue_write, (uv_stream_t *) &uv_socket, &bufs[0], bufs.size(), _on_queue_write));
+    }
+}
+
+void Socket::_on_queue_write(uv_write_t *write_req, int status)
+{
+    UV_CHECK(status);
+    Socket *socket = static_cast<Socket*>(write_req->data);
+    socket->queue_write_active = false;
+    socket->n_writes--;
+    socket->written(socket->queue_write_size);
+    socket->send_queued();
+}
+
+void Socket::_sendfile_work(uv_work_t *work)
+{
+    // The socket is non-blocking and nothing else writes into it now,
+    // so we wait for space in the socket buffer by poll. The wait is bounded,
+    // a peer that stops reading must not hold a thread of the shared pool;
+    // the job returns and it is queued again from the loop
+    Socket *socket = static_cast<Socket*>(work->data);
+    uv_os_fd_t out_fd;
+    UV_CHECK(uv_fileno((uv_handle_t*) &socket->uv_socket, &out_fd));
+    off_t end = socket->sendfile_size;
+    while (socket->sendfile_offset < end && !socket->sendfile_cancel) {
+        ssize_t r = sendfile(out_fd, socket->sendfile_fd, &socket->sendfile_offset,
+                             end - socket->sendfile_offset);
+        if (r < 0) {
+            if (errno == EAGAIN) {
+                pollfd p;
+                p.fd = out_fd;
+                p.events = POLLOUT;
+                if (poll(&p, 1, SENDFILE_POLL_TIMEOUT) == 0) {
+                    return;
+                }
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            socket->sendfile_error = errno;
+            return;
+        }
+        if (r == 0) {
+            // File is shorter than expected
+            socket->sendfile_error = EIO;
+            return;
+        }
+    }
+}
+
+void Socket::_after_sendfile(uv_work_t *work, int status)
+{
+    UV_CHECK(status);
+    Socket *socket = static_cast<Socket*>(work->data);
+    socket->sendfile_active = false;
+    if (socket->state == State::Closing) {
+        socket->close_handle();
+        return;
+    }
+    if (socket->sendfile_error) {
+        socket->on_error(-socket->sendfile_error);
+        return;
+    }
+    if (socket->sendfile_offset < static_cast<off_t>(socket->sendfile_size)) {
+        // The peer does not read now, other jobs of the pool go first
+        socket->sendfile_active = true;
+        UV_CHECK(uv_queue_work(socket->uv_socket.loop, &socket->sendfile_work,
+                               _sendfile_work, _after_sendfile));
+        return;
+    }
+    socket->written(socket->sendfile_size);
+    socket->send_queued();
+}
+
+void Socket::reserve_read_space(size_t size)
+{
+    size_t used = read_end - read_begin;
+    if (used == 0) {
+        read_begin = read_end = 0;
+        if (read_capacity > READ_BUFFER_SIZE && !stream_mode) {
+            // Release a buffer enlarged by a big message or by streaming
+            read_buffer.reset();
+            read_capacity = 0;
+        }
+    }
+    if (read_capacity - read_end >= size) {
+        return;
+    }
+    if (read_capacity - used >= size) {
+        // Move the unprocessed rest of a message to the beginning
+        memmove(read_buffer.get(), read_buffer.get() + read_begin, used);
+    } else {
+        size_t capacity = std::max(std::max(read_capacity * 2, used + size), READ_BUFFER_SIZE);
+        char *new_buffer = new char[capacity];
+        if (used) {
+            memcpy(new_buffer, read_buffer.get() + read_begin, used);
+        }
+        read_buffer.reset(new_buffer);
+        read_capacity = capacity;
+    }
+    read_begin = 0;
+    read_end = used;
 }
 
 void Socket::_buf_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
 {
-    size_t size;
     Socket *socket = static_cast<Socket*>(handle->data);
+    if (socket->stream_target) {
+        // The read buffer is empty, the data go directly to the destination
+        buf->base = socket->stream_target;
+        buf->len = socket->stream_remaining;
+        return;
+    }
+    size_t size;
     if (socket->stream_mode) {
-        size = 8 << 20; // 8 MB
+        size = STREAM_READ_SIZE;
     } else {
         size = suggested_size;
+        // Make room for the whole message if its header is already received
+        size_t used = socket->read_end - socket->read_begin;
+        if (used >= sizeof(uint64_t)) {
+            uint64_t sz;
+            memcpy(&sz, socket->read_buffer.get() + socket->read_begin, sizeof(sz));
+            size = std::max<size_t>(size, sz + sizeof(sz) - used);
+        }
     }
-    buf->base = new char[size];
-    buf->len = size;
+    socket->reserve_read_space(size);
+    buf->base = socket->read_buffer.get() + socket->read_end;
+    buf->len = socket->read_capacity - socket->read_end;
 }
 
 
@@ -116,9 +350,6 @@ void Socket::_on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
 {
     Socket *socket = static_cast<Socket *>(stream->data);
     if (nread == UV_EOF) {
-        if (buf->base) {
-            delete[] buf->base;
-        }
         socket->close();
         return;
     }
@@ -131,51 +362,68 @@ void Socket::_on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
         return;
     }
 
-    auto &buffer = socket->buffer;
-    char* data = buf->base;
-    size_t size_read = nread;
-
-    if (socket->stream_remaining) {
-         if (socket->stream_remaining >= size_read) {
-            socket->stream_remaining -= size_read;
-            socket->on_stream_data(data, size_read, socket->stream_remaining);
-            delete [] data;
-            return;
-         }
-         socket->on_stream_data(data, socket->stream_remaining, 0);
-         assert(buffer.size() == 0);
-         char *start_data = data + socket->stream_remaining;
-         socket->stream_remaining = 0;
-         buffer.insert(buffer.begin(), start_data, data + size_read);
-    } else {
-       buffer.insert(buffer.end(), data, data + size_read);
+    if (socket->stream_target) {
+        assert(buf->base == socket->stream_target);
+        assert(static_cast<size_t>(nread) <= socket->stream_remaining);
+        char *data = socket->stream_target;
+        socket->stream_remaining -= nread;
+        socket->stream_target = socket->stream_remaining ? data + nread : nullptr;
+        socket->on_stream_data(data, nread, socket->stream_remaining);
+        return;
     }
-    delete [] data;
 
+    assert(buf->base == socket->read_buffer.get() + socket->read_end);
+    socket->read_end += nread;
+    socket->process_read_buffer();
+}
+
+void Socket::process_read_buffer()
+{
+    // Data are consumed before a callback is called, since the callback
+    // may discard the buffer (close_and_discard_remaining_data)
+    // or switch the stream mode
     for (;;) {
-        size_t size = buffer.size();
+        char *data = read_buffer.get() + read_begin;
+        size_t size = read_end - read_begin;
+
+        if (stream_remaining) {
+            if (size == 0) {
+                return;
+            }
+            size_t chunk = std::min(size, stream_remaining);
+            stream_remaining -= chunk;
+            read_begin += chunk;
+            on_stream_data(data, chunk, stream_remaining);
+            continue;
+        }
+
         if (size < sizeof(uint64_t)) {
             return;
         }
-        uint64_t sz = *(reinterpret_cast<uint64_t *>(&buffer[0]));
+        uint64_t sz;
+        memcpy(&sz, data, sizeof(sz));
         uint64_t sz2 = sz + sizeof(sz);
         if (size < sz2) {
-            if (socket->stream_mode) {
+            if (stream_mode) {
                uint64_t data_size = size - sizeof(sz);
-               socket->stream_remaining = sz - data_size;
-               socket->on_stream_data(&buffer[sizeof(sz)], data_size, socket->stream_remaining);
-               buffer.clear();
+               stream_remaining = sz - data_size;
+               read_begin = read_end;
+               if (on_stream_target) {
+                   char *target = on_stream_target(sz);
+                   if (target) {
+                       stream_target = target + data_size;
+                   }
+               }
+               on_stream_data(data + sizeof(sz), data_size, stream_remaining);
             }
             return;
         }
 
-        if (!socket->stream_mode) {
-            socket->on_message(&buffer[sizeof(sz)], sz);
+        read_begin += sz2;
+        if (!stream_mode) {
+            on_message(data + sizeof(sz), sz);
         } else {
-            socket->on_stream_data(&buffer[sizeof(sz)], sz, 0);
-        }
-        if (buffer.size()) { // Buffer was not discarded by on_message/on_stream_data
-            buffer.erase(buffer.begin(), buffer.begin() + sz2);
+            on_stream_data(data + sizeof(sz), sz, 0);
         }
     }
 }
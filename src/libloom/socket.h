@@ -4,6 +4,9 @@
 #include "sendbuffer.h"
 
 #include <uv.h>
+#include <sys/types.h>
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <vector>
 #include <functional>
@@ -50,6 +53,14 @@ public:
         on_stream_data = fn;
     }
 
+    /** The function is called with the size of a stream message when its
+        header is received but the message is not complete yet. If it returns
+        a non-null pointer, the rest of the message is read directly to this
+        memory and on_stream_data is called with pointers into it */
+    void set_on_stream_target(const std::function<char*(size_t size)> &fn) {
+        on_stream_target = fn;
+    }
+
     void set_on_close(const std::function<void()> &fn) {
         on_close = fn;
     }
@@ -66,24 +77,86 @@ public:
        stream_mode = value;
     }
 
+    /** The socket becomes congested when the number of queued bytes (sent
+     *  but not written yet) reaches high, it is relieved when they drop
+     *  to low or below. By default it is never congested */
+    void set_watermarks(size_t high, size_t low) {
+        high_watermark = high;
+        low_watermark = low;
+    }
+
+    /** The function is called when the socket stops being congested */
+    void set_on_drain(const std::function<void()> &fn) {
+        on_drain = fn;
+    }
+
+    bool is_congested() const {
+        return congested;
+    }
+
+    size_t get_queued_bytes() const {
+        return queued_bytes;
+    }
+
 protected:
 
     std::function<void(const char *buffer, size_t size)> on_message;
     std::function<void(const char *buffer, size_t size, size_t remaining)> on_stream_data;
+    std::function<char*(size_t size)> on_stream_target;
     std::function<void()> on_close;
     std::function<void()> on_connect;
+    std::function<void()> on_drain;
     /** An error has occured, error_code is from libuv. */
     std::function<void(int error_code)> on_error;
 
     State state;
     uv_tcp_t uv_socket;
 
-    std::vector<char> buffer;
+    /* Receive buffer; it is reused by all reads. Unprocessed data are
+       between read_begin and read_end, messages are parsed in place */
+    std::unique_ptr<char[]> read_buffer;
+    size_t read_capacity;
+    size_t read_begin;
+    size_t read_end;
+
     bool stream_mode;
     size_t stream_remaining;
-
+    char *stream_target; // Destination of the rest of the current stream message
+
+    /* Buffers with file items are sent part by part; memory parts by uv_write
+       and files by sendfile in the thread pool. Everything sent after them
+       waits in the queue to keep the order of data */
+    std::deque<std::unique_ptr<SendBuffer>> send_queue;
+    size_t send_position; // Index of the next item of the first queued buffer
+    size_t n_writes; // Unfinished uv_write requests
+    bool queue_write_active;
+    uv_write_t queue_write;
+    bool sendfile_active;
+    uv_work_t sendfile_work;
+    int sendfile_fd;
+    size_t sendfile_size;
+    off_t sendfile_offset;
+    int sendfile_error;
+    std::atomic<bool> sendfile_cancel; // Set by close() while the job runs
+    size_t queue_write_size;
+
+    size_t queued_bytes;
+    size_t high_watermark;
+    size_t low_watermark;
+    bool congested;
 
 private:
+    void reserve_read_space(size_t size);
+    void process_read_buffer();
+    void close_handle();
+    void send_queued();
+    void written(size_t size);
+
+    static void _on_write(uv_write_t *write_req, int status);
+    static void _on_queue_write(uv_write_t *write_req, int status);
+    static void _sendfile_work(uv_work_t *work);
+    static void _after_sendfile(uv_work_t *work, int status);
+
     static void _on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf);
     static void _buf_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf);
     static void _on_resolved(uv_getaddrinfo_t *handle, int status, addrinfo *response);
@@ -4,7 +4,7 @@
 namespace loom {
 namespace base {
 
-const int PROTOCOL_VERSION = 2;
+const int PROTOCOL_VERSION = 6;
 
 typedef int Id;
 }
@@ -12,7 +12,7 @@ loom::CheckPointWriter::CheckPointWriter(loom::Worker &worker, base::Id id, cons
 
 void loom::CheckPointWriter::start()
 {
-    UV_CHECK(uv_queue_work(worker.get_loop(), &work, _work_cb, _after_work_cb));
+    worker.get_io_pool().queue_work(&work, _work_cb, _after_work_cb);
 }
 
 void loom::CheckPointWriter::_work_cb(uv_work_t *req)
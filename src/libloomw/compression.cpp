@@ -0,0 +1,138 @@
+#include "compression.h"
+#include "worker.h"
+#include "interconnect.h"
+#include "data/rawdata.h"
+
+#include "libloom/log.h"
+#include "libloom/sendbuffer.h"
+#include "libloom/compat.h"
+
+#include <algorithm>
+#include <limits.h>
+
+using namespace loom;
+using namespace loom::base;
+
+static const size_t PROBE_SIZE = 64 * 1024; // 64 kB
+static const int COMPRESSION_LEVEL = 1; // The fastest one
+
+/** The probe has to save at least 10 % */
+static bool is_compressible(const char *mem, size_t size)
+{
+    size_t probe_size = std::min(size, PROBE_SIZE);
+    uLongf compressed_size = compressBound(probe_size);
+    auto tmp = std::make_unique<char[]>(compressed_size);
+    if (compress2(reinterpret_cast<Bytef*>(tmp.get()), &compressed_size,
+                  reinterpret_cast<const Bytef*>(mem), probe_size,
+                  COMPRESSION_LEVEL) != Z_OK) {
+        return false;
+    }
+    return compressed_size < probe_size - probe_size / 10;
+}
+
+CompressionJob::CompressionJob(Worker &worker, const std::string &address,
+                               base::Id id, const DataPtr &data,
+                               std::function<void()> &&on_finish)
+    : worker(worker), address(address), id(id), data(data), on_finish(std::move(on_finish))
+{
+    work.data = this;
+}
+
+CompressionJob::~CompressionJob()
+{
+
+}
+
+void CompressionJob::start()
+{
+    UV_CHECK(uv_queue_work(worker.get_loop(), &work, _work_cb, _after_work_cb));
+}
+
+void CompressionJob::_work_cb(uv_work_t *req)
+{
+    CompressionJob *job = static_cast<CompressionJob*>(req->data);
+    const char *mem = job->data->get_raw_data();
+    size_t size = job->data->get_size();
+
+    if (!is_compressible(mem, size)) {
+        return;
+    }
+
+    uLongf compressed_size = compressBound(size);
+    auto item = std::make_unique<MemItem>(compressed_size);
+    if (compress2(reinterpret_cast<Bytef*>(item->get_ptr()), &compressed_size,
+                  reinterpret_cast<const Bytef*>(mem), size,
+                  COMPRESSION_LEVEL) != Z_OK || compressed_size >= size) {
+        return;
+    }
+    item->truncate(compressed_size);
+    job->compressed = std::move(item);
+}
+
+void CompressionJob::_after_work_cb(uv_work_t *req, int status)
+{
+    UV_CHECK(status);
+    CompressionJob *job = static_cast<CompressionJob*>(req->data);
+    auto &connection = job->worker.get_connection(job->address);
+    connection.send_compressed(job->id, job->data, std::move(job->compressed),
+                               std::move(job->on_finish));
+    delete job;
+}
+
+InflateUnpacker::InflateUnpacker(Worker &worker, size_t size)
+    : size(size), position(0)
+{
+    auto obj = std::make_shared<RawData>();
+    ptr = obj->init_empty(worker.get_globals(), size);
+    result = obj;
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        logger->critical("Cannot initialize zlib stream");
+        exit(1);
+    }
+}
+
+InflateUnpacker::~InflateUnpacker()
+{
+    inflateEnd(&stream);
+}
+
+DataUnpacker::Result InflateUnpacker::get_initial_mode()
+{
+    return STREAM;
+}
+
+DataUnpacker::Result InflateUnpacker::on_stream_data(const char *data, size_t size, size_t remaining)
+{
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = size;
+
+    int r = Z_OK;
+    while (stream.avail_in > 0 && r != Z_STREAM_END) {
+        // avail_out is only 32b
+        size_t out_size = std::min<size_t>(this->size - position, UINT_MAX);
+        stream.next_out = reinterpret_cast<Bytef*>(ptr + position);
+        stream.avail_out = out_size;
+        r = inflate(&stream, Z_NO_FLUSH);
+        position += out_size - stream.avail_out;
+        if (r != Z_OK && r != Z_STREAM_END) {
+            logger->critical("Decompression of received data failed: {}", r);
+            exit(1);
+        }
+    }
+
+    if (remaining > 0) {
+        return STREAM;
+    }
+    if (r != Z_STREAM_END || position != this->size) {
+        logger->critical("Received compressed data are incomplete");
+        exit(1);
+    }
+    return FINISHED;
+}
+
+DataPtr InflateUnpacker::finish()
+{
+    return result;
+}
@@ -0,0 +1,73 @@
+#ifndef LIBLOOMW_COMPRESSION_H
+#define LIBLOOMW_COMPRESSION_H
+
+#include "data.h"
+#include "unpacking.h"
+#include "libloom/types.h"
+
+#include <uv.h>
+#include <zlib.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace loom {
+
+class Worker;
+
+namespace base {
+class MemItem;
+}
+
+/** Compresses raw data of an object in the thread pool before it is sent
+ *  to another worker. Data that are compressed poorly (checked on a prefix)
+ *  are sent uncompressed */
+class CompressionJob {
+
+public:
+    /** Smaller objects are never compressed */
+    static const size_t MIN_SIZE = 64 * 1024; // 64 kB
+
+    CompressionJob(Worker &worker, const std::string &address, base::Id id, const DataPtr &data,
+                   std::function<void()> &&on_finish);
+    ~CompressionJob();
+
+    void start();
+
+protected:
+    uv_work_t work;
+    Worker &worker;
+    std::string address;
+    base::Id id;
+    DataPtr data;
+    std::unique_ptr<base::MemItem> compressed; // nullptr if it does not pay off
+    std::function<void()> on_finish;
+
+private:
+    static void _work_cb(uv_work_t *req);
+    static void _after_work_cb(uv_work_t *req, int status);
+};
+
+/** Receives RawData sent by CompressionJob, chunks are inflated directly
+ *  into the new object */
+class InflateUnpacker : public DataUnpacker
+{
+public:
+   InflateUnpacker(Worker &worker, size_t size);
+   ~InflateUnpacker();
+
+   Result get_initial_mode() override;
+   Result on_stream_data(const char *data, size_t size, size_t remaining) override;
+   DataPtr finish() override;
+
+private:
+   DataPtr result;
+   char *ptr;
+   size_t size;
+   size_t position;
+   z_stream stream;
+};
+
+}
+
+#endif // LIBLOOMW_COMPRESSION_H
@@ -2,7 +2,8 @@
 #include <stdlib.h>
 
 loom::Config::Config()
-    : work_dir("/tmp"), cpus(0), debug(false), pinning(true)
+    : work_dir("/tmp"), cpus(0), debug(false), pinning(true), avoid_smt(false), local_transfers(true),
+      compression(false), transfer_limit(16), peer_transfer_limit(4)
 {
 
 }
@@ -13,7 +14,13 @@ void loom::Config::parse_args(int argc, char **argv)
         { "debug", 300, 0, 0, "Debug mode"},
         { "cpus", 301, "NUMBER", 0, "Number of cpus (default: autodetect)"},
         { "wdir", 302, "DIRECTORY", 0, "Working directory (default: /tmp)"},
-        { "nopin", 303, 0, 0, "Disable pinning of processes"},
+        { "nopin", 303, 0, 0, "Disable pinning of processes and threads of tasks (and binding of their memory to NUMA nodes)"},
+        { "nolocal", 304, 0, 0, "Disable transfers through files between workers on the same host"},
+        { "compress", 305, 0, 0, "Compress data sent to workers that also use this option"},
+        { "transfers", 306, "NUMBER", 0, "Maximal number of concurrent outgoing transfers (default: 16)"},
+        { "peer-transfers", 307, "NUMBER", 0, "Maximal number of concurrent outgoing transfers to one peer (default: 4)"},
+        { "rack", 308, "LABEL", 0, "Label of the rack; the server prefers transfers within a rack"},
+        { "avoid-smt", 309, 0, 0, "Place cpus of a task on different cores (not on SMT siblings) if possible"},
         { 0 }
     };
     struct argp argp = { options, parse_opt, "SERVER-ADDRESS PORT" };
@@ -47,6 +54,32 @@ loom::Config::parse_opt (int key, char *arg,
     case 303:
         config->pinning = false;
         break;
+    case 304:
+        config->local_transfers = false;
+        break;
+    case 305:
+        config->compression = true;
+        break;
+    case 306:
+        config->transfer_limit = atoi(arg);
+        if (config->transfer_limit <= 0) {
+            fprintf(stderr, "Invalid number of transfers\n");
+            exit(1);
+        }
+        break;
+    case 307:
+        config->peer_transfer_limit = atoi(arg);
+        if (config->peer_transfer_limit <= 0) {
+            fprintf(stderr, "Invalid number of transfers\n");
+            exit(1);
+        }
+        break;
+    case 308:
+        config->rack = arg;
+        break;
+    case 309:
+        config->avoid_smt = true;
+        break;
     case ARGP_KEY_ARG:
         switch(state->arg_num) {
             case 0:
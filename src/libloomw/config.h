@@ -37,6 +37,30 @@ public:
         return pinning;
     }
 
+    bool get_avoid_smt() const {
+        return avoid_smt;
+    }
+
+    bool get_local_transfers() const {
+        return local_transfers;
+    }
+
+    bool get_compression() const {
+        return compression;
+    }
+
+    int get_transfer_limit() const {
+        return transfer_limit;
+    }
+
+    int get_peer_transfer_limit() const {
+        return peer_transfer_limit;
+    }
+
+    const std::string& get_rack() const {
+        return rack;
+    }
+
 protected:
     std::string server_address;
     std::string work_dir;
@@ -44,6 +68,12 @@ protected:
     int cpus;
     bool debug;
     bool pinning;
+    bool avoid_smt;
+    bool local_transfers;
+    bool compression;
+    int transfer_limit;
+    int peer_transfer_limit;
+    std::string rack;
 
 private:
     static int parse_opt(int key, char *arg, struct argp_state *state);
@@ -37,6 +37,11 @@ bool Data::has_raw_data() const
    return false;
 }
 
+std::string Data::get_filename() const
+{
+   return "";
+}
+
 base::Id Data::get_type_id(Worker &worker) const
 {
    return worker.get_dictionary().find_symbol(get_type_name());
@@ -55,6 +55,10 @@ public:
 
     virtual bool has_raw_data() const;
 
+    /** Get name of a file that holds the whole content of the object,
+     *  returns empty string when there is no such file */
+    virtual std::string get_filename() const;
+
     loom::base::Id get_type_id(Worker &worker) const;
 
 protected:
@@ -149,6 +149,12 @@ DataUnpacker::Result ArrayUnpacker::on_stream_data(const char *data, size_t size
    return unpack_next();
 }
 
+char* ArrayUnpacker::get_stream_target(size_t size)
+{
+   assert(unpacker);
+   return unpacker->get_stream_target(size);
+}
+
 DataPtr ArrayUnpacker::finish()
 {
    return std::make_shared<Array>(types.size(), std::move(items));
@@ -2,6 +2,8 @@
 
 #include "libloom/fsutils.h"
 #include "libloom/log.h"
+#include "libloom/sendbuffer.h"
+#include "libloom/compat.h"
 
 #include <unistd.h>
 #include <assert.h>
@@ -51,7 +53,10 @@ std::string loom::ExternFile::get_info() const
 
 size_t ExternFile::serialize(Worker &worker, loom::base::SendBuffer &buffer, const DataPtr &data_ptr) const
 {
-    assert(0); // TODO
+    // It is received as RawData (see unpacker of "loom/file" in Worker)
+    buffer.add(std::make_unique<base::SizeBufferItem>(size));
+    buffer.add(std::make_unique<base::FileItem>(filename, size));
+    return 1;
 }
 
 std::string ExternFile::map_as_file(Globals &globals) const
@@ -59,6 +64,11 @@ std::string ExternFile::map_as_file(Globals &globals) const
     return filename;
 }
 
+std::string ExternFile::get_filename() const
+{
+    return filename;
+}
+
 void ExternFile::open()
 {
     logger->debug("Opening extern file {}", filename);
@@ -119,6 +119,11 @@ DataUnpacker::Result IndexUnpacker::on_stream_data(const char *data, size_t size
     return unpacker->on_stream_data(data, size, remaining);
 }
 
+char* IndexUnpacker::get_stream_target(size_t size)
+{
+    assert(unpacker);
+    return unpacker->get_stream_target(size);
+}
 
 DataPtr IndexUnpacker::finish()
 {
@@ -44,6 +44,7 @@ public:
    explicit IndexUnpacker(Worker &worker);
    Result on_message(const char *data, size_t size) override;
    Result on_stream_data(const char *data, size_t size, size_t remaining) override;
+   char* get_stream_target(size_t size) override;
    DataPtr finish() override;
 private:
     size_t length;
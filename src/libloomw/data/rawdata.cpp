@@ -132,6 +132,12 @@ std::string RawData::map_as_file(Globals &globals) const
     return filename;
 }
 
+std::string RawData::get_filename() const
+{
+    // Small data have a file only when they were mapped as file
+    return is_mmap ? filename : "";
+}
+
 void RawData::open() const
 {
     if (size == 0) {
@@ -191,7 +197,12 @@ void RawData::init_from_mem(Globals &globals, const void *ptr, size_t size)
 size_t RawData::serialize(Worker &worker, loom::base::SendBuffer &buffer, const DataPtr &data_ptr) const
 {
     buffer.add(std::make_unique<base::SizeBufferItem>(size));
-    buffer.add(std::make_unique<DataBufferItem>(data_ptr, get_raw_data(), size));
+    if (is_mmap) {
+        // Sent directly from the file, it does not have to be mapped
+        buffer.add(std::make_unique<base::FileItem>(filename, size));
+    } else {
+        buffer.add(std::make_unique<DataBufferItem>(data_ptr, get_raw_data(), size));
+    }
     return 1;
 }
 
@@ -210,19 +221,25 @@ DataUnpacker::Result RawDataUnpacker::get_initial_mode()
     return STREAM;
 }
 
+char* RawDataUnpacker::get_stream_target(size_t size)
+{
+    assert(ptr == nullptr);
+    auto obj = std::make_shared<RawData>();
+    ptr = obj->init_empty(globals, size);
+    result = obj;
+    return ptr;
+}
+
 DataUnpacker::Result RawDataUnpacker::on_stream_data(const char *data, size_t size, size_t remaining)
 {
     if (ptr == nullptr) {
-        auto obj = std::make_shared<RawData>();
-        size_t total_size = size + remaining;
-        ptr = obj->init_empty(globals, total_size);
-        memcpy(ptr, data, size);
-        ptr += size;
-        result = obj;
-    } else {
+        get_stream_target(size + remaining);
+    }
+    if (data != ptr) {
+        // Data were not received directly to the target
         memcpy(ptr, data, size);
-        ptr += size;
     }
+    ptr += size;
 
     if (remaining == 0) {
         return FINISHED;
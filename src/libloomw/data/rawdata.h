@@ -26,6 +26,7 @@ public:
     bool has_raw_data() const override;
     std::string get_info() const override;
     std::string map_as_file(Globals &globals) const override;
+    std::string get_filename() const override;
     size_t serialize(Worker &worker, loom::base::SendBuffer &buffer, const DataPtr &data_ptr) const override;
 
     char* init_empty(loom::Globals &globals, size_t size);
@@ -56,6 +57,7 @@ public:
 
    Result get_initial_mode() override;
    Result on_stream_data(const char *data, size_t size, size_t remaining) override;
+   char* get_stream_target(size_t size) override;
    DataPtr finish() override;
 private:
    DataPtr result;
@@ -5,13 +5,23 @@
 #include "libloom/pbutils.h"
 #include "libloom/sendbuffer.h"
 
+#include "data/rawdata.h"
+#include "compression.h"
+
 #include <sstream>
+#include <string.h>
+#include <unistd.h>
 
 using namespace loom;
 using namespace loom::base;
 
+// Data are not serialized while more bytes wait in the socket
+static const size_t HIGH_WATERMARK = 64 << 20; // 64 MB
+static const size_t LOW_WATERMARK = 16 << 20; // 16 MB
+
 InterConnection::InterConnection(Worker &worker)
-    : socket(worker.get_loop()), worker(worker), unpacking_data_id(-1), received_bytes(0)
+    : socket(worker.get_loop()), worker(worker), peer_announced(false), compression(false),
+      unpacking_data_id(-1), received_bytes(0)
 {
     socket.set_on_close([this]() {
         logger->debug("Interconnection closed");
@@ -22,6 +32,11 @@ InterConnection::InterConnection(Worker &worker)
         on_connect();
     });
 
+    socket.set_watermarks(HIGH_WATERMARK, LOW_WATERMARK);
+    socket.set_on_drain([this]() {
+        send_pending();
+    });
+
     socket.set_on_message([this](const char *buffer, size_t size) {
         on_message(buffer, size);
     });
@@ -29,36 +44,52 @@ InterConnection::InterConnection(Worker &worker)
     socket.set_on_stream_data([this](const char *buffer, size_t size, size_t remaining) {
         on_stream_data(buffer, size, remaining);
     });
+
+    socket.set_on_stream_target([this](size_t size) {
+        assert(unpacker);
+        return unpacker->get_stream_target(size);
+    });
 }
 
 InterConnection::~InterConnection()
 {
-
+    for (auto &pending : pending_sends) {
+        if (pending.on_finish) {
+            pending.on_finish();
+        }
+    }
 }
 
 void InterConnection::on_connect()
 {
     logger->info("Connected to {}", get_address());
+    send_announce();
+}
+
+void InterConnection::send_announce()
+{
     loom::pb::comm::Announce msg;
     msg.set_port(worker.get_listen_port());
-
-    send_message(socket, msg);
-
-    for (auto& buffer : early_sends) {
-        socket.send(std::move(buffer));
+    auto &host_id = worker.get_host_id();
+    if (!host_id.empty()) {
+        msg.set_host_id(host_id);
+        msg.set_work_dir(worker.get_globals().get_work_dir());
     }
-    early_sends.clear();
+    if (worker.get_compression()) {
+        msg.set_compression(true);
+    }
+    send_message(socket, msg);
 }
 
-void InterConnection::finish_receive()
+void InterConnection::finish_receive(const DataPtr &data)
 {
     logger->debug("Interconnect: Data id={} received", unpacking_data_id);
     worker.data_transferred(unpacking_data_id);
-    worker.publish_data(unpacking_data_id, unpacker->finish(), "");
+    worker.publish_data(unpacking_data_id, data, "");
 
     auto &trace = worker.get_trace();
     if (trace) {
-        trace->trace_receive(unpacking_data_id, received_bytes, address);
+        trace->trace_receive(unpacking_data_id, received_bytes, address, data->get_size());
     }
 
     unpacking_data_id = -1;
@@ -69,14 +100,14 @@ void InterConnection::finish_receive()
 void InterConnection::on_message(const char *buffer, size_t size)
 {
     using namespace loom::pb::comm;
-    if (!address.empty()) {
+    if (peer_announced) {
         if (unpacker) {
             received_bytes += size;
             // Message to unpacker
             auto result = unpacker->on_message(buffer, size);
             switch(result) {
             case DataUnpacker::FINISHED:
-                finish_receive();
+                finish_receive(unpacker->finish());
                 return;
             case DataUnpacker::MESSAGE:
                 return;
@@ -90,8 +121,16 @@ void InterConnection::on_message(const char *buffer, size_t size)
             assert(msg.ParseFromArray(buffer, size));
             unpacking_data_id = msg.id();
             received_bytes = size;
+            if (msg.has_filename()) {
+                receive_file(msg.id(), msg.filename());
+                return;
+            }
             logger->debug("Interconnect: Receving data_id={}", unpacking_data_id);
-            unpacker = worker.get_unpacker(msg.type_id());
+            if (msg.has_uncompressed_size()) {
+                unpacker = std::make_unique<InflateUnpacker>(worker, msg.uncompressed_size());
+            } else {
+                unpacker = worker.get_unpacker(msg.type_id());
+            }
             switch(unpacker->get_initial_mode()) {
                 case DataUnpacker::MESSAGE:
                     // We are already in message mode
@@ -104,13 +143,26 @@ void InterConnection::on_message(const char *buffer, size_t size)
             }
         }
     } else {
-        // First message
+        // First message; the accepting side replies with its own Announce
         Announce msg;
         assert(msg.ParseFromArray(buffer, size));
-        std::stringstream s;
-        address = make_address(get_peername(), msg.port());
-        logger->debug("Interconnection from worker {} accepted", address);
-        worker.register_connection(*this);
+        peer_announced = true;
+        auto &host_id = worker.get_host_id();
+        if (!host_id.empty() && msg.has_host_id() && msg.host_id() == host_id) {
+            peer_work_dir = msg.work_dir();
+            logger->debug("Worker {} is on the same host, using transfers through files",
+                          msg.port());
+        }
+        compression = worker.get_compression() && msg.compression();
+        if (address.empty()) {
+            address = make_address(get_peername(), msg.port());
+            logger->debug("Interconnection from worker {} accepted", address);
+            send_announce();
+            worker.register_connection(*this);
+        } else {
+            // Data were kept until now, since they may go through files
+            send_pending();
+        }
     }
 }
 
@@ -122,7 +174,7 @@ void InterConnection::on_stream_data(const char *buffer, size_t size, size_t rem
     switch(result) {
     case DataUnpacker::FINISHED:
         socket.set_stream_mode(false);
-        finish_receive();
+        finish_receive(unpacker->finish());
         return;
     case DataUnpacker::MESSAGE:
         socket.set_stream_mode(false);
@@ -132,7 +184,123 @@ void InterConnection::on_stream_data(const char *buffer, size_t size, size_t rem
     }
 }
 
-void InterConnection::send(Id id, DataPtr &data)
+void InterConnection::receive_file(Id id, const std::string &filename)
+{
+    logger->debug("Interconnect: Receiving data_id={} as file {}", id, filename);
+    // The file is in our work dir, so it can be just renamed
+    auto data = std::make_shared<RawData>();
+    std::string data_filename = data->assign_filename(worker.get_globals());
+    if (rename(filename.c_str(), data_filename.c_str())) {
+        logger->critical("Cannot move {} to {}", filename, data_filename);
+        log_errno_abort("rename");
+    }
+    data->init_from_file();
+    finish_receive(data);
+}
+
+bool InterConnection::send_as_file(Id id, const DataPtr &data, const std::string &filename,
+                                   FinishFn &on_finish)
+{
+    std::stringstream s;
+    s << peer_work_dir << "data/link-" << worker.get_listen_port() << "-" << id;
+    std::string link_name = s.str();
+    if (link(filename.c_str(), link_name.c_str())) {
+        // E.g. the work dir of the peer is on another file system
+        logger->debug("Cannot link {} to {} ({}), sending data by socket",
+                      filename, link_name, strerror(errno));
+        return false;
+    }
+
+    loom::pb::comm::DataHeader msg;
+    msg.set_id(id);
+    msg.set_type_id(data->get_type_id(worker));
+    msg.set_n_messages(0);
+    msg.set_filename(link_name);
+    auto buffer = std::make_unique<loom::base::SendBuffer>();
+    buffer->add(loom::base::message_to_item(msg));
+    buffer->set_on_finish(std::move(on_finish));
+
+    auto &trace = worker.get_trace();
+    if (trace) {
+        trace->trace_send(id, buffer->get_data_size(), address, data->get_size());
+    }
+    socket.send(std::move(buffer));
+    return true;
+}
+
+void InterConnection::send(Id id, const DataPtr &data, FinishFn &&on_finish)
+{
+    if (!peer_announced || socket.is_congested() || !pending_sends.empty()) {
+        pending_sends.push_back(PendingSend{id, data, std::move(on_finish)});
+        return;
+    }
+    start_send(id, data, std::move(on_finish));
+}
+
+void InterConnection::send_pending()
+{
+    while (!pending_sends.empty() && peer_announced && !socket.is_congested()) {
+        PendingSend pending = std::move(pending_sends.front());
+        pending_sends.pop_front();
+        start_send(pending.id, pending.data, std::move(pending.on_finish));
+    }
+}
+
+void InterConnection::start_send(Id id, const DataPtr &data, FinishFn &&on_finish)
+{
+    if (!peer_work_dir.empty()) {
+        std::string filename = data->get_filename();
+        if (!filename.empty() && send_as_file(id, data, filename, on_finish)) {
+            return;
+        }
+    }
+
+    if (compression && data->has_raw_data() &&
+        data->get_size() >= CompressionJob::MIN_SIZE) {
+        // It continues by send_compressed
+        auto job = new CompressionJob(worker, address, id, data, std::move(on_finish));
+        job->start();
+        return;
+    }
+
+    send_uncompressed(id, data, std::move(on_finish));
+}
+
+void InterConnection::send_compressed(Id id, const DataPtr &data,
+                                      std::unique_ptr<base::MemItem> compressed,
+                                      FinishFn &&on_finish)
+{
+    if (!peer_announced) {
+        // The original connection was closed during compression
+        pending_sends.push_back(PendingSend{id, data, std::move(on_finish)});
+        return;
+    }
+    if (!compressed) {
+        send_uncompressed(id, data, std::move(on_finish));
+        return;
+    }
+
+    logger->debug("Interconnect: Data id={} compressed {} -> {} bytes",
+                  id, data->get_size(), compressed->get_buf().len);
+    auto buffer = std::make_unique<loom::base::SendBuffer>();
+    loom::pb::comm::DataHeader msg;
+    msg.set_id(id);
+    msg.set_type_id(data->get_type_id(worker));
+    msg.set_n_messages(1);
+    msg.set_uncompressed_size(data->get_size());
+    buffer->add(loom::base::message_to_item(msg));
+    buffer->add(std::make_unique<base::SizeBufferItem>(compressed->get_buf().len));
+    buffer->add(std::move(compressed));
+    buffer->set_on_finish(std::move(on_finish));
+
+    auto &trace = worker.get_trace();
+    if (trace) {
+        trace->trace_send(id, buffer->get_data_size(), address, data->get_size());
+    }
+    socket.send(std::move(buffer));
+}
+
+void InterConnection::send_uncompressed(Id id, const DataPtr &data, FinishFn &&on_finish)
 {
     auto buffer = std::make_unique<loom::base::SendBuffer>();
 
@@ -143,20 +311,15 @@ void InterConnection::send(Id id, DataPtr &data)
     msg.set_type_id(data->get_type_id(worker));
     msg.set_n_messages(n_messages);
     buffer->insert(0, loom::base::message_to_item(msg));
+    buffer->set_on_finish(std::move(on_finish));
 
     auto &trace = worker.get_trace();
     if (trace) {
-        trace->trace_send(id, buffer->get_data_size(), address);
+        trace->trace_send(id, buffer->get_data_size(), address, data->get_size());
     }
 
-    auto state = socket.get_state();
-    assert(state == loom::base::Socket::State::Open ||
-           state == loom::base::Socket::State::Connecting);
-    if (state == loom::base::Socket::State::Open) {
-        socket.send(std::move(buffer));
-    } else {
-        early_sends.push_back(std::move(buffer));
-    }
+    assert(socket.get_state() == loom::base::Socket::State::Open);
+    socket.send(std::move(buffer));
 }
 
 std::string InterConnection::make_address(const std::string &host, int port)
@@ -6,6 +6,8 @@
 #include "data.h"
 #include "unpacking.h"
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -19,10 +21,19 @@ class SendBuffer;
 class InterConnection
 {
 public:
+    /** Called when data were written to the socket or dropped */
+    using FinishFn = std::function<void()>;
+
     InterConnection(Worker &worker);
     ~InterConnection();
 
-    void send(base::Id id, DataPtr &data);
+    void send(base::Id id, const DataPtr &data, FinishFn &&on_finish = FinishFn());
+
+    /** Finishes send() of data processed by CompressionJob,
+     *  compressed is nullptr when data should be sent uncompressed */
+    void send_compressed(base::Id id, const DataPtr &data,
+                         std::unique_ptr<base::MemItem> compressed,
+                         FinishFn &&on_finish);
 
     std::string get_peername() {
         return socket.get_peername();
@@ -52,19 +63,40 @@ protected:
     void on_stream_data(const char *buffer, size_t size, size_t remaining);
     void on_connect();
 
-    void finish_receive();
+    void finish_receive(const DataPtr &data);
+    void send_announce();
+    void send_pending();
+    void start_send(base::Id id, const DataPtr &data, FinishFn &&on_finish);
+    void send_uncompressed(base::Id id, const DataPtr &data, FinishFn &&on_finish);
+    bool send_as_file(base::Id id, const DataPtr &data, const std::string &filename,
+                      FinishFn &on_finish);
+    void receive_file(base::Id id, const std::string &filename);
 
     base::Socket socket;
     Worker &worker;
     std::string address;
 
+    bool peer_announced;
+    /* Work dir of the peer when it is on the same host and both sides
+       allow transfers through files, otherwise empty */
+    std::string peer_work_dir;
+    bool compression; // Both sides accept compressed data
+
     std::unique_ptr<DataUnpacker> unpacker;
     base::Id unpacking_data_id;
     size_t received_bytes;
 
     static std::string make_address(const std::string &host, int port);
 
-    std::vector<std::unique_ptr<base::SendBuffer>> early_sends;
+    struct PendingSend {
+        base::Id id;
+        DataPtr data;
+        FinishFn on_finish;
+    };
+
+    /* Data sent before the peer announced itself or while
+       the socket is congested */
+    std::deque<PendingSend> pending_sends;
 };
 
 }
@@ -1,29 +1,75 @@
 
 #include "resalloc.h"
 
-#include <sstream>
+#include "libloom/log.h"
 
-std::vector<std::string> loom::taskset_command(const std::vector<int> cpus)
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using loom::base::logger;
+
+// From <numaif.h>, libnuma is not needed for the raw syscall
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+loom::ResourceAllocation::ResourceAllocation() : valid(false), numa_node(-1)
+{
+
+}
+
+loom::ThreadBinding::ThreadBinding(const std::vector<int> &cpus, int numa_node)
+    : pinned(false), memory_bound(false)
 {
-    std::vector<std::string> result;
     if (cpus.empty()) {
-        return result;
+        return;
     }
 
-    result.reserve(3);
-    result.push_back("taskset");
-    result.push_back("-c");
+    int r = pthread_getaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus);
+    if (r) {
+        logger->debug("Cannot get affinity: {}", strerror(r));
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r) {
+        // E.g. --cpus is higher than the number of cpus of the machine
+        logger->debug("Cannot pin thread: {}", strerror(r));
+        return;
+    }
+    pinned = true;
 
-    std::stringstream list;
-    list << cpus[0];
-    for (auto it = cpus.begin() + 1;  it != cpus.end(); it++) {
-        list << "," << *it;
+    const size_t bits = sizeof(unsigned long) * 8;
+    if (numa_node >= 0 && static_cast<size_t>(numa_node) < NODEMASK_WORDS * bits) {
+        if (syscall(SYS_get_mempolicy, &old_policy, old_nodemask,
+                    NODEMASK_WORDS * bits, nullptr, 0)) {
+            logger->debug("Cannot get memory policy: {}", strerror(errno));
+            return;
+        }
+        unsigned long nodemask[NODEMASK_WORDS] = {};
+        nodemask[numa_node / bits] = 1UL << (numa_node % bits);
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, NODEMASK_WORDS * bits + 1)) {
+            logger->debug("Cannot set memory policy: {}", strerror(errno));
+        } else {
+            memory_bound = true;
+        }
     }
-    result.push_back(list.str());
-    return result;
 }
 
-loom::ResourceAllocation::ResourceAllocation() : valid(false)
+loom::ThreadBinding::~ThreadBinding()
 {
-
+    if (memory_bound) {
+        const size_t bits = sizeof(unsigned long) * 8;
+        syscall(SYS_set_mempolicy, old_policy, old_nodemask, NODEMASK_WORDS * bits + 1);
+    }
+    if (pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus);
+    }
 }
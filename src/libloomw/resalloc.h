@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 
+#include <sched.h>
+
 namespace loom {
 
 class ResourceAllocation
@@ -28,12 +30,56 @@ public:
         valid = value;
     }
 
+    /** NUMA node of all cpus, -1 when cpus span more nodes
+     *  or when the machine has only one node.
+     *  It is used together with the cpus, i.e. only when pinning is enabled */
+    int get_numa_node() const {
+        return numa_node;
+    }
+
+    void set_numa_node(int value) {
+        numa_node = value;
+    }
+
 private:
     bool valid;
+    int numa_node;
     std::vector<int> cpus;
 };
 
-std::vector<std::string> taskset_command(const std::vector<int> cpus);
+/** Pins the calling thread to cpus and makes it prefer memory of numa_node
+ *  (if it is not -1) for pages it touches first, e.g. memory of RawData
+ *  created by a task. The previous affinity and memory policy (e.g. set by
+ *  numactl for the whole worker) are restored in the destructor.
+ *  Processes spawned by the thread meanwhile inherit the binding.
+ *  Nothing is done for empty cpus; memory is not bound without pinning,
+ *  since the thread may run on any node */
+class ThreadBinding
+{
+public:
+    ThreadBinding(const std::vector<int> &cpus, int numa_node);
+    ~ThreadBinding();
+
+    ThreadBinding(const ThreadBinding&) = delete;
+    ThreadBinding& operator=(const ThreadBinding&) = delete;
+
+    bool is_pinned() const {
+        return pinned;
+    }
+
+    bool is_memory_bound() const {
+        return memory_bound;
+    }
+
+private:
+    static const size_t NODEMASK_WORDS = 16; // 1024 nodes
+
+    bool pinned;
+    bool memory_bound;
+    cpu_set_t old_cpus;
+    int old_policy;
+    unsigned long old_nodemask[NODEMASK_WORDS];
+};
 
 }
 
@@ -2,19 +2,22 @@
 
 #include "libloom/log.h"
 
+#include <algorithm>
+#include <tuple>
+
 #include <unistd.h>
 
 using loom::base::logger;
 
 loom::ResourceManager::ResourceManager()
-    : total_cpus(0), free_cpus(0), zero_cost_slots(0)
+    : total_cpus(0), n_free_cpus(0), zero_cost_slots(0), max_tasks(0),
+      avoid_smt(false), n_nodes(0)
 {
 
 }
 
 void loom::ResourceManager::init(int n_cpus)
 {
-    assert(total_cpus == 0);
     if (n_cpus == 0) {
         n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
         if (n_cpus <= 0) {
@@ -23,16 +26,122 @@ void loom::ResourceManager::init(int n_cpus)
         }
         logger->debug("Autodetection of CPUs: {}", n_cpus);
     }
+    init(n_cpus, CpuTopology::flat(n_cpus), false);
+}
 
-    total_cpus = n_cpus;
+void loom::ResourceManager::init(int n_cpus, const CpuTopology &topology, bool avoid_smt)
+{
+    assert(total_cpus == 0);
+    int n_available = topology.get_cpus().size();
+    if (n_cpus == 0) {
+        if (n_available == 0) {
+            logger->critical("Cannot detect number of CPUs");
+            exit(1);
+        }
+        n_cpus = n_available;
+        logger->debug("Autodetection of CPUs: {}", n_cpus);
+    }
 
-    this->free_cpus.resize(n_cpus);
-    for (int i = 0; i < n_cpus; i++) {
-        free_cpus[i] = i;
+    CpuTopology used;
+    if (n_cpus > n_available) {
+        logger->warn("Worker has more CPUs ({}) than the machine ({}), topology is ignored",
+                     n_cpus, n_available);
+        used = CpuTopology::flat(n_cpus);
+    } else {
+        used = topology.select(n_cpus);
     }
+    cpus = used.get_cpus();
+
+    // Compact sets are taken in the order of nodes, packages and cores
+    std::sort(cpus.begin(), cpus.end(), [](const CpuInfo &a, const CpuInfo &b) {
+        return std::make_tuple(a.node, a.package, a.core, a.id) <
+               std::make_tuple(b.node, b.package, b.core, b.id);
+    });
+
+    int max_id = 0;
+    int max_node = 0;
+    for (const CpuInfo &cpu : cpus) {
+        max_id = std::max(max_id, cpu.id);
+        max_node = std::max(max_node, cpu.node);
+    }
+    cpu_index.assign(max_id + 1, -1);
+    node_free_cpus.assign(max_node + 1, 0);
+    core_free_cpus.assign(used.get_n_core_groups(), 0);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        cpu_index[cpus[i].id] = i;
+        node_free_cpus[cpus[i].node]++;
+        core_free_cpus[cpus[i].core_group]++;
+    }
+    core_sizes = core_free_cpus;
+    n_nodes = std::count_if(node_free_cpus.begin(), node_free_cpus.end(),
+                            [](int n) { return n > 0; });
+
+    total_cpus = n_cpus;
+    n_free_cpus = n_cpus;
+    free_cpus.assign(n_cpus, true);
+    this->avoid_smt = avoid_smt;
 
     zero_cost_slots = n_cpus * 2 + 1;
-    logger->info("Number of CPUs for worker: {}", n_cpus);
+    max_tasks = n_cpus + zero_cost_slots;
+    logger->info("Number of CPUs for worker: {} (NUMA nodes: {})", n_cpus, n_nodes);
+}
+
+std::vector<size_t> loom::ResourceManager::select_cpus(int n_cpus)
+{
+    // Node with the least free cpus that still fits the whole task
+    int node = -1;
+    for (size_t i = 0; i < node_free_cpus.size(); i++) {
+        if (node_free_cpus[i] >= n_cpus &&
+                (node == -1 || node_free_cpus[i] < node_free_cpus[node])) {
+            node = i;
+        }
+    }
+    std::vector<int> node_free = node_free_cpus;
+    std::vector<bool> node_used(node_free.size(), false);
+    std::vector<int> core_selected(core_free_cpus.size(), 0);
+
+    std::vector<size_t> selected;
+    selected.reserve(n_cpus);
+    for (int i = 0; i < n_cpus; i++) {
+        using Key = std::tuple<int, int, int, size_t>;
+        Key best_key;
+        size_t best = cpus.size();
+
+        for (size_t j = 0; j < cpus.size(); j++) {
+            if (!free_cpus[j]) {
+                continue;
+            }
+            const CpuInfo &cpu = cpus[j];
+
+            int node_key;
+            if (node != -1) {
+                node_key = cpu.node == node ? 0 : 1;
+            } else {
+                // Spanning nodes; stay on used nodes, then take nodes with most free cpus
+                node_key = node_used[cpu.node] ? -total_cpus - 1 : -node_free[cpu.node];
+            }
+
+            int group = cpu.core_group;
+            int smt_key = avoid_smt ? core_sizes[group] - core_free_cpus[group]
+                                    : -core_selected[group];
+            int package_key = (selected.empty() || cpus[selected[0]].package == cpu.package) ? 0 : 1;
+
+            Key key(node_key, smt_key, package_key, j);
+            if (best == cpus.size() || key < best_key) {
+                best_key = key;
+                best = j;
+            }
+        }
+        assert(best < cpus.size());
+        const CpuInfo &cpu = cpus[best];
+        free_cpus[best] = false;
+        node_free_cpus[cpu.node]--;
+        core_free_cpus[cpu.core_group]--;
+        core_selected[cpu.core_group]++;
+        node_used[cpu.node] = true;
+        selected.push_back(best);
+    }
+    return selected;
 }
 
 loom::ResourceAllocation loom::ResourceManager::allocate(int n_cpus)
@@ -46,15 +155,23 @@ loom::ResourceAllocation loom::ResourceManager::allocate(int n_cpus)
         return result;
     }
 
-    int fc = free_cpus.size();
-    if (fc >= n_cpus) {
-        for (int i = 0; i < n_cpus; i++) {
-            fc--;
-            result.add_cpu(free_cpus[fc]);
-            free_cpus.pop_back();
-        }
-        result.set_valid(true);
+    if (n_free_cpus < n_cpus) {
+        return result;
+    }
+
+    int node = -2;
+    for (size_t i : select_cpus(n_cpus)) {
+        const CpuInfo &cpu = cpus[i];
+        result.add_cpu(cpu.id);
+        node = (node == -2 || node == cpu.node) ? cpu.node : -1;
+    }
+    n_free_cpus -= n_cpus;
+
+    // Memory placement matters only when there is more than one node
+    if (n_nodes > 1) {
+        result.set_numa_node(node);
     }
+    result.set_valid(true);
     return result;
 }
 
@@ -69,8 +186,13 @@ void loom::ResourceManager::free(loom::ResourceAllocation &ra)
     }
 
     for (auto cpu_id : cpus) {
-        free_cpus.push_back(cpu_id);
+        int index = cpu_index[cpu_id];
+        assert(index >= 0 && !free_cpus[index]);
+        free_cpus[index] = true;
+        node_free_cpus[this->cpus[index].node]++;
+        core_free_cpus[this->cpus[index].core_group]++;
     }
+    n_free_cpus += cpus.size();
 
-    assert(free_cpus.size() <= static_cast<size_t>(total_cpus));
+    assert(n_free_cpus <= total_cpus);
 }
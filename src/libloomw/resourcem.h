@@ -2,6 +2,7 @@
 #define LIBLOOMW_RESOURCEM_H
 
 #include "resalloc.h"
+#include "topology.h"
 
 namespace loom {
 
@@ -9,19 +10,47 @@ class ResourceManager
 {
 public:
     ResourceManager();
+
+    /** Uses cpus 0 .. n_cpus-1 without any topology (all cpus of the machine for 0) */
     void init(int n_cpus);
 
+    /** Uses n_cpus of the topology (all for 0); when avoid_smt is set,
+     *  cpus of one task are placed on different cores if possible */
+    void init(int n_cpus, const CpuTopology &topology, bool avoid_smt);
+
     int get_total_cpus() const {
         return total_cpus;
     }
 
+    /** Maximal number of tasks that may run at once (including zero-cost tasks) */
+    int get_max_tasks() const {
+        return max_tasks;
+    }
+
+    /** Cpus of a task are taken from one NUMA node if some node has enough
+     *  free cpus, otherwise from as few nodes as possible.
+     *  The placement has an effect only when pinning is enabled (--nopin is
+     *  not used); otherwise neither cpus nor memory of the task are bound */
     ResourceAllocation allocate(int n_cpus);
     void free(ResourceAllocation &ra);
 
 private:
+    /** Takes n_cpus free cpus, returns their indices in cpus */
+    std::vector<size_t> select_cpus(int n_cpus);
+
     int total_cpus;
-    std::vector<int> free_cpus;
+    int n_free_cpus;
     int zero_cost_slots;
+    int max_tasks;
+    bool avoid_smt;
+    int n_nodes;
+
+    std::vector<CpuInfo> cpus;
+    std::vector<bool> free_cpus; // indexed as cpus
+    std::vector<int> node_free_cpus; // indexed by node
+    std::vector<int> core_free_cpus; // indexed by core group
+    std::vector<int> core_sizes; // SMT siblings in core groups
+    std::vector<int> cpu_index; // index in cpus by cpu id
 };
 
 
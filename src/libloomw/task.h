@@ -5,7 +5,6 @@
 
 #include <vector>
 #include <string>
-#include <unordered_set>
 
 
 namespace loom {
@@ -34,7 +33,8 @@ public:
         return config;
     }
 
-    bool is_ready(base::Id finished_id);
+    /** Returns true when the last unresolved input was resolved */
+    bool input_resolved();
     bool is_ready() const {
         return n_unresolved == 0;
     }
@@ -55,7 +55,9 @@ public:
         return inputs;
     }
 
-    void set_unresolved_set(std::unordered_set<base::Id> &&set);
+    void set_n_unresolved(size_t value) {
+        n_unresolved = value;
+    }
 
 protected:
     base::Id id;
@@ -64,7 +66,6 @@ protected:
     std::string config;
     int n_cpus;
     size_t n_unresolved;
-    std::unordered_set<base::Id> unresolved_set;
     std::string checkpoint_path;
 };
 
@@ -24,7 +24,7 @@ public:
     const int INTERNAL_JOB_ID = -2;
 
     TaskInstance(Worker &worker, std::unique_ptr<Task> &&task, ResourceAllocation &&ra)
-        : worker(worker), task(std::move(task)), resource_alloc(std::move(ra))
+        : worker(worker), task(std::move(task)), resource_alloc(std::move(ra)), active_index(0)
     {
 
     }
@@ -51,6 +51,15 @@ public:
         return resource_alloc;
     }
 
+    /** Position in the active tasks of the worker */
+    size_t get_active_index() const {
+        return active_index;
+    }
+
+    void set_active_index(size_t value) {
+        active_index = value;
+    }
+
     ResourceAllocation pop_resource_alloc();
     const std::string get_task_dir();
     virtual void start(DataVector &input_data) = 0;
@@ -66,6 +75,7 @@ protected:
     std::unique_ptr<Task> task;
     bool has_directory;
     ResourceAllocation resource_alloc;
+    size_t active_index;
 };
 
 }
@@ -112,31 +112,20 @@ void RunTask::start(DataVector &inputs)
 
 
    /* Setup args */
-   std::vector<std::string> prefix;
-
-   if (globals.is_pinning_enabled()) {
-        prefix = taskset_command(resource_alloc.get_cpus());
-   }
-   int prefix_size = prefix.size();
-   char *args[prefix_size + args_size + 1];
-
-   for (int i = 0; i < prefix_size; i++) {
-       args[i] = const_cast<char*>(prefix[i].c_str());
-   }
+   char *args[args_size + 1];
 
    for (int i = 0; i < args_size; i++) {
       const std::string &arg = msg.args(i);
       if (!arg.empty() && arg[0] == '$') { // Variable check
          auto it = variables.find(arg);
          if (it != variables.end()) {
-            args[i + prefix_size] = const_cast<char*>(it->second.c_str());
+            args[i] = const_cast<char*>(it->second.c_str());
             continue;
          }
       }
-      args[i + prefix_size] = const_cast<char*>(arg.c_str());
+      args[i] = const_cast<char*>(arg.c_str());
    }
-   int real_args_size = prefix_size + args_size;
-   args[real_args_size] = NULL;
+   args[args_size] = NULL;
    options.args = args;
    options.file = args[0];
    std::string work_dir = worker.get_run_dir(get_id());
@@ -145,7 +134,7 @@ void RunTask::start(DataVector &inputs)
    if (logger->level() == spdlog::level::debug) {
       std::stringstream s;
       s << args[0];
-      for (int i = 1; i < real_args_size; i++) {
+      for (int i = 1; i < args_size; i++) {
          s << ' ' << args[i];
       }
       logger->debug("Running command {}", s.str());
@@ -161,7 +150,13 @@ void RunTask::start(DataVector &inputs)
    stdio[2].data.fd = stderr_fd;
 
    int r;
-   r = uv_spawn(worker.get_loop(), &process, &options);
+   {
+      // The process inherits cpus and the memory policy of the spawning thread
+      ThreadBinding binding(globals.is_pinning_enabled() ? resource_alloc.get_cpus()
+                                                         : std::vector<int>(),
+                            resource_alloc.get_numa_node());
+      r = uv_spawn(worker.get_loop(), &process, &options);
+   }
    process.data = this;
 
    /* Cleanup */
@@ -0,0 +1,126 @@
+#include "threadpool.h"
+#include "resalloc.h"
+
+#include "libloom/log.h"
+
+using namespace loom;
+using namespace loom::base;
+
+ThreadPool::ThreadPool(const std::string &name)
+    : name(name), max_threads(0), pinning(false), n_idle(0), stop(false), closed(false),
+      n_unfinished(0)
+{
+
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    queue_cv.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::init(uv_loop_t *loop, size_t max_threads, bool pinning)
+{
+    assert(this->max_threads == 0 && max_threads > 0);
+    this->max_threads = max_threads;
+    this->pinning = pinning;
+    UV_CHECK(uv_async_init(loop, &async, _async_cb));
+    async.data = this;
+    uv_unref(reinterpret_cast<uv_handle_t*>(&async));
+    logger->debug("Thread pool '{}': max_threads={}", name, max_threads);
+}
+
+void ThreadPool::close()
+{
+    if (max_threads == 0 || closed) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        closed = true;
+    }
+    uv_close(reinterpret_cast<uv_handle_t*>(&async), nullptr);
+}
+
+void ThreadPool::queue_work(uv_work_t *req, uv_work_cb work_cb,
+                            uv_after_work_cb after_work_cb, const std::vector<int> &cpus,
+                            int numa_node)
+{
+    assert(max_threads > 0 && !closed);
+    if (n_unfinished++ == 0) {
+        uv_ref(reinterpret_cast<uv_handle_t*>(&async));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(Job{req, work_cb, after_work_cb, cpus, numa_node});
+        if (n_idle < queue.size() && threads.size() < max_threads) {
+            threads.emplace_back(&ThreadPool::thread_main, this);
+        }
+    }
+    queue_cv.notify_one();
+}
+
+void ThreadPool::thread_main()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            n_idle++;
+            queue_cv.wait(lock, [this]() {
+                return stop || !queue.empty();
+            });
+            n_idle--;
+            if (stop) {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        {
+            // Jobs without cpus (zero-cost tasks or --nopin) run anywhere and
+            // their memory is not bound
+            ThreadBinding binding(pinning ? job.cpus : std::vector<int>(), job.numa_node);
+            job.work_cb(job.req);
+        }
+
+        {
+            // The job cannot be finished in the loop (and the handle closed)
+            // before the async handle is signaled
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (!closed) {
+                done.push_back(std::move(job));
+                uv_async_send(&async);
+            }
+        }
+    }
+}
+
+void ThreadPool::_async_cb(uv_async_t *handle)
+{
+    ThreadPool *pool = static_cast<ThreadPool*>(handle->data);
+    pool->on_jobs_done();
+}
+
+void ThreadPool::on_jobs_done()
+{
+    std::vector<Job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        jobs.swap(done);
+    }
+    for (Job &job : jobs) {
+        assert(n_unfinished > 0);
+        if (--n_unfinished == 0) {
+            uv_unref(reinterpret_cast<uv_handle_t*>(&async));
+        }
+        job.after_work_cb(job.req, 0);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef LIBLOOMW_THREADPOOL_H
+#define LIBLOOMW_THREADPOOL_H
+
+#include <uv.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace loom {
+
+/** Pool of threads owned by the worker; it replaces the global thread pool
+ *  of libuv (4 threads by default) for jobs of tasks and checkpoints.
+ *  Jobs are queued in the same way as by uv_queue_work, after_work_cb is
+ *  called in the loop thread. Threads are created on demand up to the limit */
+class ThreadPool {
+
+public:
+    explicit ThreadPool(const std::string &name);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** When pinning is enabled, the thread that runs a job is bound
+     *  to the cpus and the NUMA node given with the job */
+    void init(uv_loop_t *loop, size_t max_threads, bool pinning);
+
+    /** The job is run by a thread pinned to cpus (if cpus are not empty)
+     *  that prefers memory of numa_node (if it is not -1), see ThreadBinding */
+    void queue_work(uv_work_t *req, uv_work_cb work_cb, uv_after_work_cb after_work_cb,
+                    const std::vector<int> &cpus = std::vector<int>(), int numa_node = -1);
+
+    /** Closes the async handle; after_work_cb is not called for jobs
+     *  that finish later, they are dropped as the worker is terminating.
+     *  It may be called more times */
+    void close();
+
+    size_t get_n_threads() const {
+        return threads.size();
+    }
+
+private:
+    struct Job {
+        uv_work_t *req;
+        uv_work_cb work_cb;
+        uv_after_work_cb after_work_cb;
+        std::vector<int> cpus;
+        int numa_node;
+    };
+
+    void thread_main();
+    void on_jobs_done();
+
+    std::string name;
+    size_t max_threads;
+    bool pinning;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    std::deque<Job> queue;
+    size_t n_idle;
+    bool stop;
+
+    std::mutex done_mutex;
+    std::vector<Job> done;
+    bool closed; // Written under done_mutex
+
+    // It keeps the loop alive only while there are unfinished jobs
+    uv_async_t async;
+    size_t n_unfinished;
+
+    static void _async_cb(uv_async_t *handle);
+};
+
+}
+
+#endif // LIBLOOMW_THREADPOOL_H
@@ -0,0 +1,132 @@
+#include "topology.h"
+
+#include "libloom/log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <tuple>
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace loom;
+using namespace loom::base;
+
+static int read_int_file(const std::string &path, int default_value)
+{
+    std::ifstream f(path);
+    int value;
+    if (!(f >> value)) {
+        return default_value;
+    }
+    return value;
+}
+
+/** Cpu directory contains link "nodeX" to its NUMA node */
+static int read_node(const std::string &cpu_dir)
+{
+    DIR *dir = opendir(cpu_dir.c_str());
+    if (!dir) {
+        return 0;
+    }
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char *name = entry->d_name;
+        if (strncmp(name, "node", 4) == 0 && name[4] >= '0' && name[4] <= '9') {
+            node = atoi(name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+CpuTopology CpuTopology::read(const std::string &sysfs_dir)
+{
+    CpuTopology topology;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set)) {
+        log_errno_abort("sched_getaffinity");
+    }
+    for (int id = 0; id < CPU_SETSIZE; id++) {
+        if (!CPU_ISSET(id, &set)) {
+            continue;
+        }
+        std::string cpu_dir = sysfs_dir + "/cpu" + std::to_string(id);
+        int package = read_int_file(cpu_dir + "/topology/physical_package_id", 0);
+        int core = read_int_file(cpu_dir + "/topology/core_id", id);
+        topology.add_cpu(id, package, core, read_node(cpu_dir));
+    }
+    logger->debug("Cpu topology: {} cpus, {} NUMA nodes",
+                  topology.cpus.size(), topology.get_n_nodes());
+    return topology;
+}
+
+CpuTopology CpuTopology::flat(int n_cpus)
+{
+    CpuTopology topology;
+    for (int id = 0; id < n_cpus; id++) {
+        topology.add_cpu(id, 0, id, 0);
+    }
+    return topology;
+}
+
+void CpuTopology::add_cpu(int id, int package, int core, int node)
+{
+    auto it = core_group_index.insert(std::make_pair(std::make_pair(package, core),
+                                                     static_cast<int>(core_groups.size())));
+    int group = it.first->second;
+    if (it.second) {
+        core_groups.emplace_back();
+    }
+    core_groups[group].push_back(cpus.size());
+    cpus.push_back(CpuInfo{id, package, core, node, group});
+}
+
+int CpuTopology::get_n_nodes() const
+{
+    std::set<int> nodes;
+    for (const CpuInfo &cpu : cpus) {
+        nodes.insert(cpu.node);
+    }
+    return nodes.size();
+}
+
+CpuTopology CpuTopology::select(int n_cpus) const
+{
+    assert(n_cpus <= static_cast<int>(cpus.size()));
+
+    // Rank of cpu among its SMT siblings
+    std::vector<int> ranks(cpus.size(), 0);
+    for (const std::vector<size_t> &group : core_groups) {
+        for (size_t i : group) {
+            for (size_t j : group) {
+                if (cpus[j].id < cpus[i].id) {
+                    ranks[i]++;
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> order(cpus.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this, &ranks](size_t a, size_t b) {
+        const CpuInfo &ca = cpus[a];
+        const CpuInfo &cb = cpus[b];
+        return std::make_tuple(ca.node, ranks[a], ca.package, ca.core, ca.id) <
+               std::make_tuple(cb.node, ranks[b], cb.package, cb.core, cb.id);
+    });
+
+    CpuTopology result;
+    for (int i = 0; i < n_cpus; i++) {
+        const CpuInfo &cpu = cpus[order[i]];
+        result.add_cpu(cpu.id, cpu.package, cpu.core, cpu.node);
+    }
+    return result;
+}
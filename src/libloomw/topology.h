@@ -0,0 +1,55 @@
+#ifndef LIBLOOMW_TOPOLOGY_H
+#define LIBLOOMW_TOPOLOGY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace loom {
+
+struct CpuInfo {
+    int id;
+    int package;
+    int core; // Cpus with the same package and core are SMT siblings
+    int node;
+    int core_group; // Dense index of the physical core (package, core)
+};
+
+/** Layout of cpus available to the worker: packages, NUMA nodes and SMT siblings */
+class CpuTopology
+{
+public:
+    /** Reads cpus in the affinity mask of the process from sysfs;
+     *  missing information is replaced by a flat layout
+     *  (every cpu is a core of its own in package 0 and node 0) */
+    static CpuTopology read(const std::string &sysfs_dir = "/sys/devices/system/cpu");
+
+    /** Cpus 0 .. n_cpus-1 in one package and one node, without SMT */
+    static CpuTopology flat(int n_cpus);
+
+    void add_cpu(int id, int package, int core, int node);
+
+    const std::vector<CpuInfo>& get_cpus() const {
+        return cpus;
+    }
+
+    int get_n_nodes() const;
+
+    /** Number of physical cores, core groups of cpus are 0 .. n-1 */
+    int get_n_core_groups() const {
+        return core_groups.size();
+    }
+
+    /** Returns first n_cpus in the order of nodes; within a node,
+     *  SMT siblings are taken after all its cores */
+    CpuTopology select(int n_cpus) const;
+
+private:
+    std::vector<CpuInfo> cpus;
+    std::vector<std::vector<size_t>> core_groups; // Indices of SMT siblings in cpus
+    std::map<std::pair<int, int>, int> core_group_index; // (package, core) -> group
+};
+
+}
+
+#endif // LIBLOOMW_TOPOLOGY_H
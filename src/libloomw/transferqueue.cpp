@@ -0,0 +1,88 @@
+#include "transferqueue.h"
+
+#include "libloom/log.h"
+
+using namespace loom;
+using namespace loom::base;
+
+TransferQueue::TransferQueue(uv_loop_t *loop, size_t total_limit, size_t peer_limit)
+    : idle_active(false), total_limit(total_limit), peer_limit(peer_limit),
+      n_active(0), seq(0)
+{
+    assert(total_limit > 0 && peer_limit > 0);
+    UV_CHECK(uv_idle_init(loop, &idle));
+    idle.data = this;
+}
+
+TransferQueue::~TransferQueue()
+{
+
+}
+
+void TransferQueue::close()
+{
+    uv_handle_t *handle = reinterpret_cast<uv_handle_t*>(&idle);
+    if (!uv_is_closing(handle)) {
+        uv_close(handle, nullptr);
+    }
+}
+
+void TransferQueue::add(const std::string &address, Id id, const DataPtr &data, int64_t priority)
+{
+    waiting.insert(Transfer{priority, seq++, address, id, data});
+    schedule_start();
+}
+
+void TransferQueue::schedule_start()
+{
+    if (idle_active || waiting.empty() ||
+            uv_is_closing(reinterpret_cast<uv_handle_t*>(&idle))) {
+        return;
+    }
+    idle_active = true;
+    UV_CHECK(uv_idle_start(&idle, _idle_callback));
+}
+
+void TransferQueue::_idle_callback(uv_idle_t *idle)
+{
+    UV_CHECK(uv_idle_stop(idle));
+    TransferQueue *queue = static_cast<TransferQueue*>(idle->data);
+    queue->idle_active = false;
+    queue->start_transfers();
+}
+
+void TransferQueue::start_transfers()
+{
+    auto i = waiting.begin();
+    while (i != waiting.end() && n_active < total_limit) {
+        size_t &peer_active = active_per_peer[i->address];
+        if (peer_active >= peer_limit) {
+            ++i;
+            continue;
+        }
+        peer_active++;
+        n_active++;
+        Transfer transfer = *i;
+        i = waiting.erase(i);
+
+        logger->debug("Starting transfer id={} to {} (priority={}, waiting={})",
+                      transfer.id, transfer.address, transfer.priority, waiting.size());
+        std::string address = transfer.address;
+        start_fn(transfer.address, transfer.id, transfer.data, [this, address]() {
+            finished(address);
+        });
+    }
+}
+
+void TransferQueue::finished(const std::string &address)
+{
+    auto i = active_per_peer.find(address);
+    assert(i != active_per_peer.end() && i->second > 0 && n_active > 0);
+    if (--i->second == 0) {
+        active_per_peer.erase(i);
+    }
+    n_active--;
+    // It may be called from callbacks of connections, so transfers
+    // are started later
+    schedule_start();
+}
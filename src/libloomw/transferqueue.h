@@ -0,0 +1,88 @@
+#ifndef LIBLOOMW_TRANSFERQUEUE_H
+#define LIBLOOMW_TRANSFERQUEUE_H
+
+#include "data.h"
+#include "libloom/types.h"
+
+#include <uv.h>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace loom {
+
+/** Outgoing transfers of data objects to other workers (or to the server).
+ *  Only a limited number of transfers is active at once, in total and per
+ *  peer; waiting transfers are started by priority (higher first), transfers
+ *  with the same priority in the order in which they were added */
+class TransferQueue {
+
+public:
+    using FinishFn = std::function<void()>;
+
+    /** Starts a transfer; finish has to be called (exactly once) when the
+     *  transfer is done or dropped */
+    using StartFn = std::function<void(const std::string &address, base::Id id,
+                                       const DataPtr &data, FinishFn &&finish)>;
+
+    /** Limits have to be positive */
+    TransferQueue(uv_loop_t *loop, size_t total_limit, size_t peer_limit);
+    ~TransferQueue();
+
+    void set_start_fn(StartFn &&start_fn) {
+        this->start_fn = std::move(start_fn);
+    }
+
+    /** Transfers are not started immediately but in the next loop iteration,
+     *  so all commands received at once are ordered by priorities */
+    void add(const std::string &address, base::Id id, const DataPtr &data, int64_t priority);
+
+    /** Closes the idle handle, has to be called before the loop is closed;
+     *  it may be called more times */
+    void close();
+
+    size_t get_n_waiting() const {
+        return waiting.size();
+    }
+
+    size_t get_n_active() const {
+        return n_active;
+    }
+
+private:
+    struct Transfer {
+        int64_t priority;
+        size_t seq;
+        std::string address;
+        base::Id id;
+        DataPtr data;
+
+        bool operator<(const Transfer &other) const {
+            if (priority != other.priority) {
+                return priority > other.priority;
+            }
+            return seq < other.seq;
+        }
+    };
+
+    void schedule_start();
+    void start_transfers();
+    void finished(const std::string &address);
+
+    uv_idle_t idle;
+    bool idle_active;
+    StartFn start_fn;
+    size_t total_limit;
+    size_t peer_limit;
+    size_t n_active;
+    size_t seq;
+    std::set<Transfer> waiting;
+    std::unordered_map<std::string, size_t> active_per_peer;
+
+    static void _idle_callback(uv_idle_t *idle);
+};
+
+}
+
+#endif // LIBLOOMW_TRANSFERQUEUE_H
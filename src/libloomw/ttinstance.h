@@ -28,7 +28,9 @@ public:
     virtual void start(DataVector &input_data) override {
         job.set_inputs(input_data);
         if (job.check_run_in_thread()) {
-            UV_CHECK(uv_queue_work(worker.get_loop(), &work, _work_cb, _after_work_cb));
+            worker.get_task_pool().queue_work(&work, _work_cb, _after_work_cb,
+                                              resource_alloc.get_cpus(),
+                                              resource_alloc.get_numa_node());
         } else {
             _work_cb(&work);
             _after_work_cb(&work, 0);
@@ -21,3 +21,8 @@ DataUnpacker::Result DataUnpacker::on_stream_data(const char *data, size_t size,
 {
    assert(0);
 }
+
+char* DataUnpacker::get_stream_target(size_t size)
+{
+   return nullptr;
+}
@@ -23,6 +23,12 @@ public:
    virtual Result get_initial_mode();
    virtual Result on_message(const char *data, size_t size);
    virtual Result on_stream_data(const char *data, size_t size, size_t remaining);
+
+   /** Returns memory where a stream of the given size can be received
+    *  directly, or nullptr when data should be passed by on_stream_data only.
+    *  When a target is provided, on_stream_data is still called for each
+    *  chunk, but data may already point into the target */
+   virtual char* get_stream_target(size_t size);
    virtual DataPtr finish() = 0;
 };
 
@@ -28,17 +28,34 @@
 
 #include <stdlib.h>
 #include <sstream>
+#include <fstream>
 #include <unistd.h>
 
 using namespace loom;
 using namespace loom::base;
 
 static const int MONITORING_PERIOD = 1000; // [ms]
+static const size_t IO_THREADS = 2;
+
+/** Workers with the same host id see the same files; hostname alone may be
+ *  shared by containers or reused, hence boot id is added */
+static std::string read_host_id(const char *hostname)
+{
+    std::ifstream f("/proc/sys/kernel/random/boot_id");
+    std::string boot_id;
+    if (!(f >> boot_id)) {
+        return "";
+    }
+    return std::string(hostname) + "/" + boot_id;
+}
 
 
 Worker::Worker(uv_loop_t *loop,
                const Config &config)
     : loop(loop),
+      task_pool("tasks"),
+      io_pool("io"),
+      transfer_queue(loop, config.get_transfer_limit(), config.get_peer_transfer_limit()),
       server_conn(loop),
       server_port(config.get_port())
 {
@@ -58,6 +75,15 @@ Worker::Worker(uv_loop_t *loop,
     start_tasks_idle.data = this;
     UV_CHECK(uv_timer_init(loop, &monitoring_timer));
     monitoring_timer.data = this;
+    flush_active = false;
+    UV_CHECK(uv_prepare_init(loop, &flush_prepare));
+    flush_prepare.data = this;
+
+    transfer_queue.set_start_fn([this](const std::string &address, Id id,
+                                       const DataPtr &data,
+                                       TransferQueue::FinishFn &&finish) {
+        get_connection(address).send(id, data, std::move(finish));
+    });
 
     listener.start(loop, 0, [this]() {
         auto connection = std::make_unique<InterConnection>(*this);
@@ -107,9 +133,16 @@ Worker::Worker(uv_loop_t *loop,
         }
 
         logger->info("Using '{}' as working directory", work_dir);
+
+        // Peers use the work dir from their own cwd, so it has to be absolute
+        if (config.get_local_transfers() && work_dir[0] == '/') {
+            host_id = read_host_id(tmp);
+        }
     }
 
     globals.init(work_dir, config.get_pinning());
+    compression = config.get_compression();
+    rack = config.get_rack();
 
     if (config.get_pinning()) {
         logger->debug("Pinning enabled");
@@ -117,7 +150,9 @@ Worker::Worker(uv_loop_t *loop,
         logger->info("Pinning disabled");
     }
 
-    resource_manager.init(config.get_cpus());
+    resource_manager.init(config.get_cpus(), CpuTopology::read(), config.get_avoid_smt());
+    task_pool.init(loop, resource_manager.get_max_tasks(), config.get_pinning());
+    io_pool.init(loop, IO_THREADS, false);
 
     server_conn.set_on_error([this](int error_code) {
        logger->critical("Server connection error: {}", uv_strerror(error_code));
@@ -147,6 +182,9 @@ Worker::Worker(uv_loop_t *loop,
        return std::make_unique<IndexUnpacker>(*this);
     });
     add_unpacker("loom/pyobj", std::make_unique<PyObjUnpacker>);
+    add_unpacker("loom/file", [this]() {
+       return std::make_unique<RawDataUnpacker>(*this);
+    });
 }
 
 
@@ -208,6 +246,9 @@ void Worker::register_worker()
 
     msg.set_port(get_listen_port());
     msg.set_cpus(resource_manager.get_total_cpus());
+    if (!rack.empty()) {
+        msg.set_rack(rack);
+    }
 
     for (auto& factory : unregistered_task_factories) {
         msg.add_task_types(factory->get_name());
@@ -251,12 +292,28 @@ void Worker::create_trace(const std::string &trace_path, Id worker_id)
 
 void Worker::new_task(std::unique_ptr<Task> task)
 {
+    Task *t = task.get();
+    size_t n_unresolved = 0;
+    for (Id id : task->get_inputs()) {
+        if (has_data(id)) {
+            continue;
+        }
+        auto &waiting = waiting_for_data[id];
+        // Only this task is added here, so a repeated input is at the back
+        if (waiting.empty() || waiting.back() != t) {
+            waiting.push_back(t);
+            n_unresolved++;
+        }
+    }
+    task->set_n_unresolved(n_unresolved);
+
     if (task->is_ready()) {
         ready_tasks.push_back(std::move(task));
         check_ready_tasks();
         return;
     }
-    waiting_tasks.push_back(std::move(task));
+    Id id = task->get_id();
+    waiting_tasks[id] = std::move(task);
 }
 
 void Worker::start_task(std::unique_ptr<Task> task, ResourceAllocation &&ra)
@@ -275,7 +332,7 @@ void Worker::start_task(std::unique_ptr<Task> task, ResourceAllocation &&ra)
     }
     auto task_instance = i->second->make_instance(*this, std::move(task), std::move(ra));
     TaskInstance *t = task_instance.get();
-    active_tasks.push_back(std::move(task_instance));
+    add_active_task(std::move(task_instance));
 
     DataVector input_data;
     for (Id id : t->get_inputs()) {
@@ -287,45 +344,41 @@ void Worker::start_task(std::unique_ptr<Task> task, ResourceAllocation &&ra)
 
 void Worker::checkpoint_written(Id id) {
     logger->debug("Checkpoint written id={}", id);
-    if (server_conn.is_connected()) {
-        loom::pb::comm::WorkerResponse msg;
-        msg.set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_WRITTEN);
-        msg.set_id(id);
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_WRITTEN);
+        msg->set_id(id);
     }
 }
 
 void Worker::checkpoint_write_failed(Id id, const std::string &error_msg) {
     logger->debug("Cannot write checkpoint id={}, error={}", id, error_msg);
-    if (server_conn.is_connected()) {
-        loom::pb::comm::WorkerResponse msg;
-        msg.set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_WRITE_FAILED);
-        msg.set_id(id);
-        msg.set_error_msg(error_msg);
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_WRITE_FAILED);
+        msg->set_id(id);
+        msg->set_error_msg(error_msg);
     }
 }
 
 void Worker::checkpoint_loaded(Id id, const DataPtr &data) {
     logger->debug("Checkpoint loaded id={}", id);
-    if (server_conn.is_connected()) {
-        loom::pb::comm::WorkerResponse msg;
-        msg.set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_LOADED);
-        msg.set_id(id);
-        msg.set_size(data->get_size());
-        msg.set_length(data->get_length());
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_LOADED);
+        msg->set_id(id);
+        msg->set_size(data->get_size());
+        msg->set_length(data->get_length());
     }
 }
 
 void Worker::checkpoint_load_failed(Id id, const std::string &error_msg) {
     logger->debug("Cannot load checkpoint id={}, error={}", id, error_msg);
-    if (server_conn.is_connected()) {
-        loom::pb::comm::WorkerResponse msg;
-        msg.set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_LOAD_FAILED);
-        msg.set_id(id);
-        msg.set_error_msg(error_msg);
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(loom::pb::comm::WorkerResponse_Type_CHECKPOINT_LOAD_FAILED);
+        msg->set_id(id);
+        msg->set_error_msg(error_msg);
     }
 }
 
@@ -385,6 +438,18 @@ void Worker::close_all()
     for (auto& c : nonregistered_connections) {
         c->close();
     }
+
+    // Handles of the worker; it may be called again from on_close of server_conn
+    for (uv_handle_t *handle : { reinterpret_cast<uv_handle_t*>(&start_tasks_idle),
+                                 reinterpret_cast<uv_handle_t*>(&flush_prepare),
+                                 reinterpret_cast<uv_handle_t*>(&monitoring_timer) }) {
+        if (!uv_is_closing(handle)) {
+            uv_close(handle, nullptr);
+        }
+    }
+    transfer_queue.close();
+    task_pool.close();
+    io_pool.close();
 }
 
 void Worker::register_connection(InterConnection &connection)
@@ -428,6 +493,37 @@ std::string Worker::get_run_dir(Id id)
     return s.str();
 }
 
+loom::pb::comm::WorkerResponse* Worker::add_response()
+{
+    if (!server_conn.is_connected()) {
+        return nullptr;
+    }
+    if (!flush_active) {
+        flush_active = true;
+        UV_CHECK(uv_prepare_start(&flush_prepare, _flush_callback));
+    }
+    return responses.add_responses();
+}
+
+void Worker::flush_responses()
+{
+    if (responses.responses_size() == 0) {
+        return;
+    }
+    if (server_conn.is_connected()) {
+        send_message(server_conn, responses);
+    }
+    responses.Clear();
+}
+
+void Worker::_flush_callback(uv_prepare_t *prepare)
+{
+    UV_CHECK(uv_prepare_stop(prepare));
+    Worker *worker = static_cast<Worker*>(prepare->data);
+    worker->flush_active = false;
+    worker->flush_responses();
+}
+
 void Worker::_start_tasks_callback(uv_idle_t *idle)
 {
     // How many tasks may be started in one callback at once
@@ -462,7 +558,8 @@ void Worker::_monitoring_callback(uv_timer_t *handle)
 
 void Worker::check_ready_tasks()
 {
-    if (start_tasks_flag || ready_tasks.empty()) {
+    if (start_tasks_flag || ready_tasks.empty() ||
+            uv_is_closing(reinterpret_cast<uv_handle_t*>(&start_tasks_idle))) {
         return;
     }
     start_tasks_flag = true;
@@ -471,16 +568,21 @@ void Worker::check_ready_tasks()
 
 void Worker::check_waiting_tasks(Id finished_id)
 {
+    auto i = waiting_for_data.find(finished_id);
+    if (i == waiting_for_data.end()) {
+        return;
+    }
+    std::vector<Task*> tasks = std::move(i->second);
+    waiting_for_data.erase(i);
+
     bool something_new = false;
-    auto i = waiting_tasks.begin();
-    while (i != waiting_tasks.end()) {
-        auto& task_ptr = *i;
-        if (task_ptr->is_ready(finished_id)) {
-            ready_tasks.push_back(std::move(task_ptr));
-            i = waiting_tasks.erase(i);
+    for (Task *task : tasks) {
+        if (task->input_resolved()) {
+            auto t = waiting_tasks.find(task->get_id());
+            assert(t != waiting_tasks.end());
+            ready_tasks.push_back(std::move(t->second));
+            waiting_tasks.erase(t);
             something_new = true;
-        } else {
-            ++i;
         }
     }
     if (something_new) {
@@ -517,18 +619,26 @@ void Worker::on_dictionary_updated()
     unregistered_unpack_ffs.clear();
 }
 
+void Worker::add_active_task(std::unique_ptr<TaskInstance> task_instance)
+{
+    task_instance->set_active_index(active_tasks.size());
+    active_tasks.push_back(std::move(task_instance));
+}
+
 void Worker::remove_task(TaskInstance &task, bool free_resources)
 {
     if (free_resources) {
         resource_manager.free(task.get_resource_alloc());
     }
-    for (auto i = active_tasks.begin(); i != active_tasks.end(); i++) {
-        if ((*i)->get_id() == task.get_id()) {
-            active_tasks.erase(i);
-            return;
-        }
+    size_t index = task.get_active_index();
+    assert(index < active_tasks.size() && active_tasks[index].get() == &task);
+    // The instance is destroyed at the end of the function
+    std::unique_ptr<TaskInstance> removed = std::move(active_tasks[index]);
+    if (index + 1 != active_tasks.size()) {
+        active_tasks[index] = std::move(active_tasks.back());
+        active_tasks[index]->set_active_index(index);
     }
-    assert(0);
+    active_tasks.pop_back();
 }
 
 void Worker::load_checkpoint(Id id, const std::string &path) {
@@ -548,12 +658,11 @@ void Worker::load_checkpoint(Id id, const std::string &path) {
 void Worker::task_failed(TaskInstance &task, const std::string &error_msg)
 {
     logger->error("Task id={} failed: {}", task.get_id(), error_msg);
-    if (server_conn.is_connected()) {
-        loom::pb::comm::WorkerResponse msg;
-        msg.set_type(loom::pb::comm::WorkerResponse_Type_FAILED);
-        msg.set_id(task.get_id());
-        msg.set_error_msg(error_msg);
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(loom::pb::comm::WorkerResponse_Type_FAILED);
+        msg->set_id(task.get_id());
+        msg->set_error_msg(error_msg);
     }
     remove_task(task);
     check_ready_tasks();
@@ -580,7 +689,7 @@ void Worker::task_redirect(TaskInstance &task,
                                                   std::move(new_task),
                                                   std::move(resource_alloc));
     TaskInstance *t = task_instance.get();
-    active_tasks.push_back(std::move(task_instance));
+    add_active_task(std::move(task_instance));
     t->start(new_task_desc->inputs);
 }
 
@@ -593,13 +702,12 @@ void Worker::write_checkpoint(Id id, const DataPtr &data, const std::string &che
 void Worker::task_finished(TaskInstance &task, const DataPtr &data, bool checkpointing)
 {
     using namespace loom::pb::comm;
-    if (server_conn.is_connected()) {
-        WorkerResponse msg;
-        msg.set_type(checkpointing ? WorkerResponse_Type_FINISHED_AND_CHECKPOINTING : WorkerResponse_Type_FINISHED);
-        msg.set_id(task.get_id());
-        msg.set_size(data->get_size());
-        msg.set_length(data->get_length());
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(checkpointing ? WorkerResponse_Type_FINISHED_AND_CHECKPOINTING : WorkerResponse_Type_FINISHED);
+        msg->set_id(task.get_id());
+        msg->set_size(data->get_size());
+        msg->set_length(data->get_length());
     }
 
     if (trace) {
@@ -614,44 +722,46 @@ void Worker::task_finished(TaskInstance &task, const DataPtr &data, bool checkpo
 void Worker::data_transferred(base::Id task_id)
 {
     using namespace loom::pb::comm;
-    if (server_conn.is_connected()) {
-        WorkerResponse msg;
-        msg.set_type(WorkerResponse_Type_TRANSFERED);
-        msg.set_id(task_id);
-        send_message(server_conn, msg);
+    auto msg = add_response();
+    if (msg) {
+        msg->set_type(WorkerResponse_Type_TRANSFERED);
+        msg->set_id(task_id);
     }
 }
 
-void Worker::send_data(const std::string &address, Id id, DataPtr &data)
+void Worker::send_data(const std::string &address, Id id, const DataPtr &data, int64_t priority)
 {
-    auto &connection = get_connection(address);;
-    connection.send(id, data);
+    transfer_queue.add(address, id, data, priority);
 }
 
 void Worker::on_message(const char *data, size_t size)
 {
     using namespace loom::pb;
-    comm::WorkerCommand msg;
-    assert(msg.ParseFromArray(data, size));
+    comm::WorkerCommandBatch batch;
+    bool parsed = batch.ParseFromArray(data, size);
+    assert(parsed);
+    (void) parsed;
+    for (int i = 0; i < batch.commands_size(); i++) {
+        on_command(*batch.mutable_commands(i));
+    }
+}
+
+void Worker::on_command(loom::pb::comm::WorkerCommand &msg)
+{
+    using namespace loom::pb;
     auto type = msg.type();
 
     switch (type) {
     case comm::WorkerCommand_Type_TASK: {
         logger->debug("Task id={} received", msg.id());
-        std::unordered_set<base::Id> unresolved_set;
         auto task = std::make_unique<Task>(msg.id(),
                                            msg.task_type(),
                                            msg.task_config(),
                                            msg.n_cpus(),
                                            msg.checkpoint_path());
         for (int i = 0; i < msg.task_inputs_size(); i++) {
-            Id task_id = msg.task_inputs(i);
-            task->add_input(task_id);
-            if(!this->has_data(task_id)) {
-                unresolved_set.insert(task_id);
-            }
+            task->add_input(msg.task_inputs(i));
         }
-        task->set_unresolved_set(std::move(unresolved_set));
         new_task(std::move(task));
         break;
     }
@@ -665,8 +775,9 @@ void Worker::on_message(const char *data, size_t size)
         if (address.size() > 2 && address[0] == '!' && address[1] == ':') {
             msg.set_address(get_server_address() + ":" + address.substr(2, std::string::npos));
         }
-        logger->debug("Sending data id={} to {}", msg.id(), msg.address());
-        assert(send_data(msg.address(), msg.id()));
+        logger->debug("Sending data id={} to {} (priority={})",
+                      msg.id(), msg.address(), msg.priority());
+        assert(send_data(msg.address(), msg.id(), msg.priority()));
         break;
     }
     case comm::WorkerCommand_Type_UPDATE: {
@@ -8,9 +8,12 @@
 #include "resourcem.h"
 #include "wtrace.h"
 #include "globals.h"
+#include "transferqueue.h"
+#include "threadpool.h"
 
 #include "libloom/dictionary.h"
 #include "libloom/listener.h"
+#include "pb/comm.pb.h"
 
 #include <uv.h>
 
@@ -42,13 +45,15 @@ public:
     void register_basic_tasks();
 
     void new_task(std::unique_ptr<Task> task);
-    void send_data(const std::string &address, base::Id id, DataPtr &data);
-    bool send_data(const std::string &address, base::Id id) {
+    /** Data are queued, they are sent when limits of transfers allow it */
+    void send_data(const std::string &address, base::Id id, const DataPtr &data,
+                   int64_t priority = 0);
+    bool send_data(const std::string &address, base::Id id, int64_t priority = 0) {
         auto& data = public_data[id];
         if (data.get() == nullptr) {
             return false;
         }
-        send_data(address, id, data);
+        send_data(address, id, data, priority);
         return true;
     }
 
@@ -108,6 +113,16 @@ public:
         return globals;
     }
 
+    /** Identification of the host for transfers through files,
+     *  empty when they are disabled */
+    const std::string& get_host_id() const {
+        return host_id;
+    }
+
+    bool get_compression() const {
+        return compression;
+    }
+
     std::string get_run_dir(base::Id id);
 
     void check_waiting_tasks(base::Id finished_id);
@@ -127,6 +142,17 @@ public:
         return trace;
     }
 
+    /** Threads for jobs of tasks; there is a thread for each task that
+     *  may run at once */
+    ThreadPool& get_task_pool() {
+        return task_pool;
+    }
+
+    /** Threads for writing checkpoints, so they do not wait for tasks */
+    ThreadPool& get_io_pool() {
+        return io_pool;
+    }
+
 
 
     void on_dictionary_updated();
@@ -141,19 +167,35 @@ private:
     void register_worker();
     void create_trace(const std::string &trace_path, loom::base::Id worker_id);
 
+    void add_active_task(std::unique_ptr<TaskInstance> task_instance);
     void remove_task(TaskInstance &task, bool free_resources=true);
     void start_task(std::unique_ptr<Task> task, ResourceAllocation &&ra);
     //int get_listen_port();
 
     void on_message(const char *data, size_t size);
+    void on_command(loom::pb::comm::WorkerCommand &msg);
+
+    /** Responses are not sent immediately, they are collected and sent
+     *  as one message at the end of the loop iteration.
+     *  Returns nullptr when the worker is not connected to the server */
+    loom::pb::comm::WorkerResponse* add_response();
+    void flush_responses();
 
     uv_loop_t *loop;
 
     ResourceManager resource_manager;
 
-    std::deque<std::unique_ptr<TaskInstance>> active_tasks;
+    // Each instance knows its index, so it is removed in O(1)
+    std::vector<std::unique_ptr<TaskInstance>> active_tasks;
+
+    // Pools are destroyed (joined) before the instances whose jobs they run
+    ThreadPool task_pool;
+    ThreadPool io_pool;
     std::deque<std::unique_ptr<Task>> ready_tasks;
-    std::deque<std::unique_ptr<Task>> waiting_tasks;
+    // Tasks waiting for inputs; task id -> task
+    std::unordered_map<base::Id, std::unique_ptr<Task>> waiting_tasks;
+    // Inverted index of waiting tasks; data id -> tasks that wait for it
+    std::unordered_map<base::Id, std::vector<Task*>> waiting_for_data;
     std::unordered_map<base::Id, std::unique_ptr<TaskFactory>> task_factories;
 
     std::unordered_map<int, DataPtr> public_data;
@@ -161,6 +203,9 @@ private:
 
     std::unordered_map<base::Id, UnpackFactoryFn> unpack_ffs;
 
+    // It has to outlive connections, they report finished transfers
+    TransferQueue transfer_queue;
+
     base::Socket server_conn;
     std::unordered_map<std::string, std::unique_ptr<InterConnection>> connections;
     std::vector<std::unique_ptr<InterConnection>> nonregistered_connections;
@@ -168,6 +213,9 @@ private:
     base::Dictionary dictionary;
 
     std::string server_address;
+    std::string host_id;
+    std::string rack;
+    bool compression;
     int server_port;
 
     base::Listener listener;
@@ -178,11 +226,16 @@ private:
     bool start_tasks_flag;
     uv_idle_t start_tasks_idle;
 
+    loom::pb::comm::WorkerResponseBatch responses;
+    bool flush_active;
+    uv_prepare_t flush_prepare;
+
     std::unique_ptr<WorkerTrace> trace;
     uv_timer_t monitoring_timer;
 
     static void _on_getaddrinfo(uv_getaddrinfo_t* handle, int status, struct addrinfo* response);
     static void _start_tasks_callback(uv_idle_t *idle);
+    static void _flush_callback(uv_prepare_t *prepare);
     static void _monitoring_callback(uv_timer_t* handle);
 };
 
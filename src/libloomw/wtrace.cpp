@@ -127,14 +127,14 @@ void WorkerTrace::trace_monitoring()
     entry('M', percent, read_mem_usage_percent());
 }
 
-void WorkerTrace::trace_send(base::Id id, size_t size, const std::string &target)
+void WorkerTrace::trace_send(base::Id id, size_t size, const std::string &target, size_t data_size)
 {
     trace_time();
-    entry('D', id, size, target);
+    entry('D', id, size, target, data_size);
 }
 
-void WorkerTrace::trace_receive(base::Id id, size_t size, const std::string &target)
+void WorkerTrace::trace_receive(base::Id id, size_t size, const std::string &target, size_t data_size)
 {
     trace_time();
-    entry('R', id, size, target);
+    entry('R', id, size, target, data_size);
 }
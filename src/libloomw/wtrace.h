@@ -14,8 +14,10 @@ public:
     void trace_task_started(const Task &task);
     void trace_task_finished(const Task &task);
     void trace_monitoring();
-    void trace_send(base::Id id, size_t size, const std::string &target);
-    void trace_receive(base::Id id, size_t size, const std::string &target);
+    /** size is the number of bytes sent over the connection
+     *  (it differs from data_size for compressed data or links) */
+    void trace_send(base::Id id, size_t size, const std::string &target, size_t data_size);
+    void trace_receive(base::Id id, size_t size, const std::string &target, size_t data_size);
 
 private:
     uint64_t last_monitoring_time;
@@ -6,6 +6,8 @@
 #include "libloom/compat.h"
 #include "libloom/pbutils.h"
 
+#include <limits>
+
 
 using namespace loom;
 using namespace loom::base;
@@ -72,6 +74,14 @@ void ClientConnection::on_message(const char *buffer, size_t size)
         Stats *stats = cmsg.mutable_stats();
         stats->set_n_workers(server.get_connections().size());
         stats->set_n_data_objects(server.get_task_manager().get_n_of_data_objects());
+        Dictionary &dictionary = server.get_dictionary();
+        for (auto &pair : server.get_task_manager().get_estimator().get_estimates()) {
+            TaskTypeStats *s = stats->add_task_types();
+            s->set_task_type(dictionary.translate(pair.first));
+            s->set_n_samples(pair.second.n_samples);
+            s->set_duration(pair.second.duration);
+            s->set_size(pair.second.size);
+        }
         send_message(cmsg);
         return;
     }
@@ -115,13 +125,15 @@ void ClientConnection::fetch(Id id)
     if (!node) {
        return;
     }
-    WorkerConnection *owner = node->get_random_owner();
+    WorkerConnection *owner = node->select_owner(nullptr);
     if (!owner) {
         logger->error("Client asked for nonfinished task; id={}", id);
         send_error("Task is not finished");
         return;
     }
-    owner->send_data(id, server.get_dummy_worker().get_address());
+    // The client waits for the data, so they go before inputs of tasks
+    owner->send_data(id, server.get_dummy_worker().get_address(),
+                     std::numeric_limits<int64_t>::max());
 }
 
 void ClientConnection::release(Id id)
@@ -7,6 +7,10 @@
 #include "libloom/log.h"
 #include "libloom/fsutils.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+
 constexpr static double TRANSFER_COST_COEF = 1.0 / (1024 * 1024); // 1MB = 1cost
 
 using namespace loom::base;
@@ -20,14 +24,110 @@ ComputationState::ComputationState(Server &server) : server(server)
    dget_task_id = dictionary.find_or_create("loom/scheduler/dget");
 }
 
-void ComputationState::add_node(std::unique_ptr<TaskNode> &&node) {
-    auto id = node->get_id();
+NodeBlock::NodeBlock(Id id_base, size_t size, size_t inputs_size,
+                     size_t nexts_size, size_t strings_size)
+    : id_base(id_base),
+      size(size),
+      n_created(0),
+      n_alive(0),
+      node_storage(new NodeStorage[size]),
+      alive(size, false),
+      inputs(new TaskNode*[inputs_size]),
+      input_slots(new uint32_t[inputs_size]),
+      inputs_size(inputs_size),
+      inputs_used(0),
+      nexts(new TaskNode*[nexts_size]),
+      next_edges(new uint32_t[nexts_size]),
+      nexts_size(nexts_size),
+      nexts_used(0),
+      strings(new char[strings_size]),
+      strings_size(strings_size),
+      strings_used(0)
+{
+
+}
+
+NodeBlock::~NodeBlock()
+{
+    for (size_t i = 0; i < n_created; i++) {
+        if (alive[i]) {
+            nodes()[i].~TaskNode();
+        }
+    }
+}
+
+TaskNode& NodeBlock::create_node(const TaskDef &def, size_t n_nexts)
+{
+    assert(n_created < size);
+    size_t index = n_created++;
+    TaskNode *node = new (&nodes()[index]) TaskNode(id_base + index, def);
+    alive[index] = true;
+    n_alive++;
+
+    if (!def.inputs.empty()) {
+        size_t first_input = def.inputs.begin() - inputs.get();
+        assert(first_input + def.inputs.size() <= inputs_used);
+        node->set_input_slots(&input_slots[first_input]);
+    }
+    assert(nexts_used + n_nexts <= nexts_size);
+    node->set_nexts_storage(&nexts[nexts_used], &next_edges[nexts_used], n_nexts);
+    nexts_used += n_nexts;
+    return *node;
+}
+
+void NodeBlock::grow_nexts(TaskNode &node, size_t count)
+{
+    assert(contains(node.get_id()));
+    size_t capacity = node.get_nexts_capacity() + count;
+    grown_nexts.emplace_back(new TaskNode*[capacity]);
+    grown_next_edges.emplace_back(new uint32_t[capacity]);
+    node.set_nexts_storage(grown_nexts.back().get(), grown_next_edges.back().get(), capacity);
+}
+
+void NodeBlock::remove_node(TaskNode &node)
+{
+    size_t index = node.get_id() - id_base;
+    assert(alive[index]);
+    node.~TaskNode();
+    alive[index] = false;
+    n_alive--;
+}
+
+TaskNode** NodeBlock::alloc_inputs(size_t count)
+{
+    assert(inputs_used + count <= inputs_size);
+    TaskNode **result = &inputs[inputs_used];
+    inputs_used += count;
+    return result;
+}
+
+StringRef NodeBlock::add_string(const std::string &str)
+{
+    if (str.empty()) {
+        return StringRef();
+    }
+    assert(strings_used + str.size() + 1 <= strings_size);
+    char *ptr = &strings[strings_used];
+    memcpy(ptr, str.c_str(), str.size() + 1);
+    strings_used += str.size() + 1;
+    return StringRef(ptr, str.size());
+}
 
-    auto result = nodes.insert(std::make_pair(id, std::move(node)));
-    assert(result.second); // Check that ID is fresh
+NodeBlock* ComputationState::find_block(Id id) const
+{
+    auto it = blocks.upper_bound(id);
+    if (it == blocks.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (!it->second->contains(id)) {
+        return nullptr;
+    }
+    return it->second.get();
 }
 
-void ComputationState::plan_node(TaskNode &node, bool load_checkpoints, std::vector<TaskNode *> &to_load) {
+void ComputationState::plan_node(TaskNode &node, bool load_checkpoints,
+                                 std::vector<TaskNode *> &to_load, std::vector<TaskNode*> &ready) {
     if (node.is_planned()) {
         return;
     }
@@ -40,75 +140,79 @@ void ComputationState::plan_node(TaskNode &node, bool load_checkpoints, std::vec
     }
 
     int remaining_inputs = 0;
-    for (TaskNode *input_node : node.get_inputs()) {
-        plan_node(*input_node, load_checkpoints, to_load);
+    const NodeSpan &inputs = node.get_inputs();
+    for (uint32_t i = 0; i < inputs.size(); i++) {
+        TaskNode *input_node = inputs[i];
+        plan_node(*input_node, load_checkpoints, to_load, ready);
         if (!input_node->is_computed()) {
             remaining_inputs += 1;
         }
-        input_node->add_next(&node);
+        input_node->add_next(&node, i);
     }
     node.set_remaining_inputs(remaining_inputs);
     if (remaining_inputs == 0) {
-        pending_nodes.insert(&node);
+        ready.push_back(&node);
     }
 }
 
-void ComputationState::reserve_new_nodes(size_t size)
-{
-    nodes.reserve(nodes.size() + size);
-}
-
 TaskNode *ComputationState::get_node_ptr(Id id)
 {
-    auto it = nodes.find(id);
-    if (it == nodes.end()) {
+    NodeBlock *block = find_block(id);
+    if (block == nullptr) {
         return nullptr;
     }
-    return it->second.get();
+    return block->get_node(id);
 }
 
 TaskNode& ComputationState::get_node(Id id)
 {
-    auto it = nodes.find(id);
-    if (it == nodes.end()) {
+    TaskNode *node = get_node_ptr(id);
+    if (node == nullptr) {
        logger->critical("Cannot find node id={}", id);
        abort();
     }
-    return *it->second;
+    return *node;
 }
 
 const TaskNode &ComputationState::get_node(Id id) const
 {
-   auto it = nodes.find(id);
-   if (it == nodes.end()) {
+   NodeBlock *block = find_block(id);
+   TaskNode *node = block ? block->get_node(id) : nullptr;
+   if (node == nullptr) {
       logger->critical("Cannot find node id={}", id);
       abort();
    }
-   return *it->second;
+   return *node;
 }
 
 void ComputationState::activate_pending_node(TaskNode &node, WorkerConnection *wc)
 {
-   auto it = pending_nodes.find(&node);
-   assert(it != pending_nodes.end());
-   pending_nodes.erase(it);
+   bool found = pending_nodes.erase(&node);
+   assert(found);
+   (void) found;
    node.set_as_running(wc);
 }
 
 void ComputationState::remove_node(TaskNode &node)
 {
-   auto it = nodes.find(node.get_id());
-   assert(it != nodes.end());
-   nodes.erase(it);
+   auto it = blocks.find(find_block(node.get_id())->get_id_base());
+   assert(it != blocks.end());
+   NodeBlock &block = *it->second;
+   block.remove_node(node);
+   if (block.get_n_alive() == 0) {
+      blocks.erase(it);
+   }
 }
 
 int ComputationState::get_n_data_objects() const
 {
     int count = 0;
-    for (auto& pair : nodes) {
-        if (pair.second->is_computed()) {
-            count += 1;
-        }
+    for (auto& pair : blocks) {
+        pair.second->foreach_node([&count](const TaskNode &node) {
+            if (node.is_computed()) {
+                count += 1;
+            }
+        });
     }
     return count;
 }
@@ -277,26 +381,60 @@ loom::base::Id ComputationState::add_plan(const loom::pb::comm::Plan &plan, bool
         resources.push_back(rr.resources(0).value());
     }
 
-    reserve_new_nodes(task_size);
+    if (task_size == 0) {
+        return id_base;
+    }
+
+    // All memory of the block is allocated at once; nexts are counted
+    // per node, nodes of previous plans get room for their new nexts
+    size_t inputs_size = 0;
+    size_t nexts_size = 0;
+    size_t strings_size = 0;
+    std::vector<size_t> n_nexts(task_size, 0);
+    std::unordered_map<TaskNode*, size_t> old_nexts;
+    for (int i = 0; i < task_size; i++) {
+        const auto& pt = plan.tasks(i);
+        inputs_size += pt.input_ids_size();
+        strings_size += pt.config().size() + 1 + pt.checkpoint_path().size() + 1;
+        for (Id input_id : pt.input_ids()) {
+            if (input_id >= id_base && input_id < id_base + i) {
+                n_nexts[input_id - id_base]++;
+                nexts_size++;
+            } else {
+                old_nexts[&get_node(input_id)]++;
+            }
+        }
+    }
+    for (auto &pair : old_nexts) {
+        find_block(pair.first->get_id())->grow_nexts(*pair.first, pair.second);
+    }
+    assert(find_block(id_base) == nullptr && find_block(id_base + task_size - 1) == nullptr);
+    NodeBlock *block = new NodeBlock(id_base, task_size, inputs_size, nexts_size, strings_size);
+    blocks[id_base] = std::unique_ptr<NodeBlock>(block);
+
+    // Ready nodes are queued after ranks are computed, since ranks are keys of the queue
+    std::vector<TaskNode*> ready;
+
     for (int i = 0; i < task_size; i++) {
         const auto& pt = plan.tasks(i);
-        auto id = i + id_base;
 
         TaskDef def;
 
         def.task_type = pt.task_type();
-        def.config = pt.config();
-        def.checkpoint_path = pt.checkpoint_path();
+        def.config = block->add_string(pt.config());
+        def.checkpoint_path = block->add_string(pt.checkpoint_path());
         bool is_result = false;
         if (pt.has_result() && pt.result()) {
             is_result = true;
             def.flags.set(static_cast<size_t>(TaskDefFlags::RESULT));
         }
 
-        auto inputs_size = pt.input_ids_size();
-        for (int j = 0; j < inputs_size; j++) {
-            def.inputs.push_back(&get_node(pt.input_ids(j)));
+        auto n_inputs = pt.input_ids_size();
+        TaskNode **inputs = block->alloc_inputs(n_inputs);
+        for (int j = 0; j < n_inputs; j++) {
+            inputs[j] = &get_node(pt.input_ids(j));
         }
+        def.inputs = NodeSpan(inputs, n_inputs);
 
         int n_cpus = 0;
         if (pt.resource_request_index() != -1) {
@@ -306,15 +444,84 @@ loom::base::Id ComputationState::add_plan(const loom::pb::comm::Plan &plan, bool
         }
         def.n_cpus = n_cpus;
 
-        auto new_node = std::make_unique<TaskNode>(id, std::move(def));
+        TaskNode &new_node = block->create_node(def, n_nexts[i]);
         if (is_result) {
-            plan_node(*new_node.get(), load_checkpoints, to_load);
+            plan_node(new_node, load_checkpoints, to_load, ready);
         }
-        add_node(std::move(new_node));
+    }
+    compute_ranks(id_base, task_size);
+    for (TaskNode *node : ready) {
+        pending_nodes.insert(node);
     }
     return id_base;
 }
 
+int64_t ComputationState::estimate_duration(const TaskNode &node) const
+{
+    return estimator.predict_duration(node.get_task_def().task_type);
+}
+
+void ComputationState::compute_ranks(loom::base::Id id_base, int task_size)
+{
+    // Inputs of a task always have lower ids, so going backwards
+    // we always have ranks of all nexts
+    for (int i = task_size - 1; i >= 0; i--) {
+        TaskNode &node = get_node(id_base + i);
+        int64_t rank = 0;
+        for (TaskNode *next_node : node.get_nexts()) {
+            rank = std::max(rank, next_node->get_rank());
+        }
+        node.set_rank(rank + estimate_duration(node));
+    }
+
+    // Propagate ranks to not yet computed nodes from previous plans
+    std::vector<TaskNode*> stack;
+    for (int i = 0; i < task_size; i++) {
+        TaskNode &node = get_node(id_base + i);
+        for (TaskNode *input_node : node.get_inputs()) {
+            if (input_node->get_id() < id_base) {
+                stack.push_back(&node);
+                break;
+            }
+        }
+    }
+    while (!stack.empty()) {
+        TaskNode *node = stack.back();
+        stack.pop_back();
+        for (TaskNode *input_node : node->get_inputs()) {
+            if (input_node->is_computed()) {
+                continue;
+            }
+            int64_t rank = node->get_rank() + estimate_duration(*input_node);
+            if (rank > input_node->get_rank()) {
+                pending_nodes.update_rank(input_node, rank);
+                stack.push_back(input_node);
+            }
+        }
+    }
+}
+
+void ComputationState::update_ranks()
+{
+    // Nexts of a not computed node are not computed either,
+    // so their ranks are already updated when the node is reached
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+        it->second->foreach_node_reverse([this](TaskNode &node) {
+            if (node.is_computed()) {
+                return;
+            }
+            int64_t rank = 0;
+            for (TaskNode *next_node : node.get_nexts()) {
+                rank = std::max(rank, next_node->get_rank());
+            }
+            rank += estimate_duration(node);
+            if (rank != node.get_rank()) {
+                pending_nodes.update_rank(&node, rank);
+            }
+        });
+    }
+}
+
 void ComputationState::test_ready_nodes(std::vector<Id> ids)
 {
     pending_nodes.clear();
@@ -323,19 +530,9 @@ void ComputationState::test_ready_nodes(std::vector<Id> ids)
     }
 }
 
-std::unique_ptr<TaskNode> ComputationState::pop_node(Id id)
-{
-    std::unique_ptr<TaskNode> result;
-    auto it = nodes.find(id);
-    assert(it != nodes.end());
-    result = std::move(it->second);
-    nodes.erase(it);
-    return result;
-}
-
 void ComputationState::clear_all()
 {
     pending_nodes.clear();
-    nodes.clear();
+    blocks.clear();
 }
 
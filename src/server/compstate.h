@@ -2,8 +2,13 @@
 #define LOOM_SERVER_COMPSTATE_H
 
 #include "tasknode.h"
+#include "estimator.h"
+#include "readyqueue.h"
 
 #include <unordered_set>
+#include <map>
+#include <memory>
+#include <type_traits>
 
 namespace loom {
 namespace pb {
@@ -15,16 +20,113 @@ class Plan;
 
 class Server;
 
+/** Memory of nodes of one plan. Nodes are stored in the order of their ids,
+ *  inputs, nexts and strings of all nodes are stored in flat arrays.
+ *  Nexts from later plans do not fit into the arrays, a node that gets them
+ *  moves its nexts into a chunk of its block (see grow_nexts).
+ *  The block is freed when the last of its nodes is removed.
+ *
+ *  Tradeoff: a plan costs a few allocations instead of several per node,
+ *  but removed nodes do not return their memory. A node that stays alive
+ *  (a result not yet fetched by the client, or a kept object) pins the
+ *  memory of its whole plan, so a big plan with a few long lived results
+ *  holds all of its memory until they are removed. */
+class NodeBlock {
+public:
+    NodeBlock(loom::base::Id id_base, size_t size, size_t inputs_size,
+              size_t nexts_size, size_t strings_size);
+    ~NodeBlock();
+
+    NodeBlock(const NodeBlock&) = delete;
+    NodeBlock& operator=(const NodeBlock&) = delete;
+
+    loom::base::Id get_id_base() const {
+        return id_base;
+    }
+
+    size_t get_n_alive() const {
+        return n_alive;
+    }
+
+    bool contains(loom::base::Id id) const {
+        return id >= id_base && id < id_base + static_cast<loom::base::Id>(size);
+    }
+
+    /** Returns nullptr if the node was not created yet or it was removed */
+    TaskNode* get_node(loom::base::Id id) {
+        size_t index = id - id_base;
+        return alive[index] ? &nodes()[index] : nullptr;
+    }
+
+    /** Nodes has to be created in the order of ids; inputs of def has to be
+     *  allocated by alloc_inputs, n_nexts is the number of uses of the node
+     *  as an input in this plan */
+    TaskNode& create_node(const TaskDef &def, size_t n_nexts);
+    void remove_node(TaskNode &node);
+
+    /** Makes room for count more nexts of a node of this block */
+    void grow_nexts(TaskNode &node, size_t count);
+
+    TaskNode** alloc_inputs(size_t count);
+    StringRef add_string(const std::string &str);
+
+    template<typename F> void foreach_node(const F &f) {
+        for (size_t i = 0; i < n_created; i++) {
+            if (alive[i]) {
+                f(nodes()[i]);
+            }
+        }
+    }
+
+    /** Nodes in the reverse order of ids, i.e. nexts before their inputs */
+    template<typename F> void foreach_node_reverse(const F &f) {
+        for (size_t i = n_created; i > 0; i--) {
+            if (alive[i - 1]) {
+                f(nodes()[i - 1]);
+            }
+        }
+    }
+
+private:
+    using NodeStorage = std::aligned_storage<sizeof(TaskNode), alignof(TaskNode)>::type;
+
+    TaskNode* nodes() {
+        return reinterpret_cast<TaskNode*>(node_storage.get());
+    }
+
+    loom::base::Id id_base;
+    size_t size;
+    size_t n_created;
+    size_t n_alive;
+    std::unique_ptr<NodeStorage[]> node_storage;
+    std::vector<bool> alive;
+
+    std::unique_ptr<TaskNode*[]> inputs;
+    std::unique_ptr<uint32_t[]> input_slots; // Parallel to inputs
+    size_t inputs_size;
+    size_t inputs_used;
+
+    std::unique_ptr<TaskNode*[]> nexts;
+    std::unique_ptr<uint32_t[]> next_edges; // Parallel to nexts
+    size_t nexts_size;
+    size_t nexts_used;
+
+    // Nexts of nodes that got more nexts from later plans
+    std::vector<std::unique_ptr<TaskNode*[]>> grown_nexts;
+    std::vector<std::unique_ptr<uint32_t[]>> grown_next_edges;
+
+    std::unique_ptr<char[]> strings;
+    size_t strings_size;
+    size_t strings_used;
+};
+
 class ComputationState {
 public:
 
     ComputationState(Server &server);
 
-    void add_node(std::unique_ptr<TaskNode> &&node);
     void add_worker(WorkerConnection* wc);
 
-    void reserve_new_nodes(size_t size);
-
     TaskNode* get_node_ptr(loom::base::Id id);
     TaskNode& get_node(loom::base::Id id);
     const TaskNode& get_node(loom::base::Id id) const;
@@ -33,7 +135,8 @@ public:
         return !pending_nodes.empty();
     }
 
-    const std::unordered_set<TaskNode*>& get_pending_tasks() const {
+    /** Ready tasks that were not started yet; in the order of priority */
+    const ReadyQueue& get_pending_tasks() const {
         return pending_nodes;
     }
 
@@ -48,26 +151,44 @@ public:
 
     loom::base::Id pop_result_client_id(loom::base::Id id);
 
+    Estimator& get_estimator() {
+        return estimator;
+    }
+
+    const Estimator& get_estimator() const {
+        return estimator;
+    }
+
+    /** Predicted duration of the task in ms */
+    int64_t estimate_duration(const TaskNode &node) const;
+
+    /** Recomputes ranks of all not computed nodes from current predictions;
+     *  it is called when Estimator::add_sample reports stale ranks */
+    void update_ranks();
+
     Server& get_server() const {
         return server;
     }
 
     template<typename F> void foreach_node(const F &f) {
-        for (auto &pair : nodes) {
-            f(pair.second);
+        for (auto &pair : blocks) {
+            pair.second->foreach_node(f);
         }
     }
 
-    std::unique_ptr<TaskNode> pop_node(loom::base::Id id);
     void clear_all();
     void add_pending_node(TaskNode &node);    
-    void plan_node(TaskNode &node, bool load_checkpoints, std::vector<TaskNode*> &to_load);
+    void plan_node(TaskNode &node, bool load_checkpoints,
+                   std::vector<TaskNode*> &to_load, std::vector<TaskNode*> &ready);
     void fail_task_on_worker(WorkerConnection &conn);
 private:
-    std::unordered_map<loom::base::Id, std::unique_ptr<TaskNode>> nodes;
-    std::unordered_set<TaskNode*> pending_nodes;
+    NodeBlock* find_block(loom::base::Id id) const;
+
+    std::map<loom::base::Id, std::unique_ptr<NodeBlock>> blocks; // by id_base
+    ReadyQueue pending_nodes;
 
     Server &server;
+    Estimator estimator;
     loom::base::Id dslice_task_id;
     loom::base::Id dget_task_id;
 
@@ -84,6 +205,8 @@ private:
                                        const PlanNode &node,
                                        std::unordered_set<loom::base::Id> &nonlocals);*/
     int get_max_cpus();
+
+    void compute_ranks(loom::base::Id id_base, int task_size);
 };
 
 
@@ -69,8 +69,13 @@ void DWConnection::on_message(const char *buffer, size_t size)
 {
    using namespace loom::pb::comm;
    if (!registered) {
-      // This is first message: Announce, we do not care, so we drop it
+      // This is first message: Announce, we do not care about its content
+      // but the worker waits for our Announce before it sends data.
+      // It does not contain host id, data are always sent through the socket
       registered = true;
+      Announce msg;
+      msg.set_port(worker.get_listen_port());
+      send_message(socket, msg);
       return;
    }
 
@@ -0,0 +1,60 @@
+#include "estimator.h"
+
+#include <stdlib.h>
+
+constexpr int64_t Estimator::DEFAULT_DURATION;
+constexpr size_t Estimator::DEFAULT_SIZE;
+constexpr double Estimator::RANK_UPDATE_RATIO;
+
+// Weight of a new sample
+constexpr static double ALPHA = 0.25;
+
+bool Estimator::add_sample(loom::base::Id task_type, uint64_t duration, size_t size)
+{
+    auto it = estimates.find(task_type);
+    if (it == estimates.end()) {
+        Estimate &e = estimates[task_type];
+        e.duration = duration;
+        e.size = size;
+        e.n_samples = 1;
+        // Ranks of nodes of an unknown type use the default duration
+        e.ranked_duration = DEFAULT_DURATION;
+        return update_ranked_duration(task_type, e);
+    }
+    Estimate &e = it->second;
+    e.duration += ALPHA * (duration - e.duration);
+    e.size += ALPHA * (size - e.size);
+    e.n_samples++;
+    return update_ranked_duration(task_type, e);
+}
+
+// Predictions that moved only a little are not worth of updating ranks
+bool Estimator::update_ranked_duration(loom::base::Id task_type, Estimate &e)
+{
+    int64_t predicted = predict_duration(task_type);
+    if (std::abs(predicted - e.ranked_duration) <= e.ranked_duration * RANK_UPDATE_RATIO) {
+        return false;
+    }
+    e.ranked_duration = predicted;
+    return true;
+}
+
+int64_t Estimator::predict_duration(loom::base::Id task_type) const
+{
+    auto it = estimates.find(task_type);
+    if (it == estimates.end()) {
+        return DEFAULT_DURATION;
+    }
+    // Every task counts at least 1ms, so ranks grow along paths
+    int64_t duration = static_cast<int64_t>(it->second.duration);
+    return duration > 0 ? duration : 1;
+}
+
+size_t Estimator::predict_size(loom::base::Id task_type) const
+{
+    auto it = estimates.find(task_type);
+    if (it == estimates.end()) {
+        return DEFAULT_SIZE;
+    }
+    return static_cast<size_t>(it->second.size);
+}
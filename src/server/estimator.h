@@ -0,0 +1,50 @@
+#ifndef LOOM_SERVER_ESTIMATOR_H
+#define LOOM_SERVER_ESTIMATOR_H
+
+#include "libloom/types.h"
+
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Online model of task durations and output sizes.
+ *  It keeps an exponentially weighted moving average per task type,
+ *  samples come from finished tasks */
+class Estimator {
+
+public:
+    struct Estimate {
+        double duration; // ms
+        double size; // bytes
+        size_t n_samples;
+        int64_t ranked_duration; // ms, prediction that ranks were computed with
+    };
+
+    /** Duration that is used for task types without samples */
+    static constexpr int64_t DEFAULT_DURATION = 100; // ms
+
+    /** Output size that is used for task types without samples */
+    static constexpr size_t DEFAULT_SIZE = 5 << 20; // 5 MB
+
+    /** Relative change of a predicted duration that makes ranks stale */
+    static constexpr double RANK_UPDATE_RATIO = 0.5;
+
+    /** Returns true when the predicted duration moved by more than
+     *  RANK_UPDATE_RATIO from the prediction that ranks were computed with;
+     *  the caller has to update ranks then */
+    bool add_sample(loom::base::Id task_type, uint64_t duration, size_t size);
+
+    int64_t predict_duration(loom::base::Id task_type) const;
+    size_t predict_size(loom::base::Id task_type) const;
+
+    const std::unordered_map<loom::base::Id, Estimate>& get_estimates() const {
+        return estimates;
+    }
+
+private:
+    bool update_ranked_duration(loom::base::Id task_type, Estimate &e);
+
+    std::unordered_map<loom::base::Id, Estimate> estimates;
+};
+
+#endif // LOOM_SERVER_ESTIMATOR_H
@@ -73,6 +73,7 @@ void FreshConnection::on_message(const char *buffer, size_t size)
                                                         data_types,
                                                         msg.cpus(),
                                                         server.new_id());
+        wconn->set_rack(msg.rack());
 
         server.add_worker_connection(std::move(wconn));
         server.remove_freshconnection(*this);
@@ -0,0 +1,135 @@
+#include "scheduler.h"
+#include "workerconn.h"
+
+#include <algorithm>
+#include <limits.h>
+
+TaskDistribution FifoScheduler::schedule()
+{
+    TaskDistribution result;
+
+    auto &pending = cstate.get_pending_tasks();
+    if (pending.empty()) {
+        return result;
+    }
+
+    size_t total_free_cpus;
+    size_t total_cpus;
+    std::vector<WorkerConnection*> workers = init_workers(total_free_cpus, total_cpus);
+    if (total_free_cpus == 0) {
+        return result;
+    }
+
+    // Workers by free cpus; max-heap of (free_cpus, -index)
+    std::vector<std::pair<int, int>> worker_heap;
+    worker_heap.reserve(workers.size());
+    int max_cpus = 0;
+    for (WorkerConnection *wc : workers) {
+        max_cpus = std::max(max_cpus, wc->get_resource_cpus());
+        if (wc->get_scheduler_free_cpus() > 0) {
+            worker_heap.push_back(std::make_pair(wc->get_scheduler_free_cpus(),
+                                                 -wc->get_scheduler_index()));
+        }
+    }
+    std::make_heap(worker_heap.begin(), worker_heap.end());
+
+    // Tasks are taken from the top of the ready queue until workers are full
+    for (auto it = pending.begin(); it != pending.end() && !worker_heap.empty(); ++it) {
+        TaskNode *node = *it;
+        auto &top = worker_heap.front();
+        if (top.first < node->get_n_cpus()) {
+            if (node->get_n_cpus() > max_cpus) {
+                // Task does not fit even into an idle worker, do not wait for it
+                continue;
+            }
+            // Strict FIFO; later tasks do not overtake the task
+            break;
+        }
+        WorkerConnection *wc = workers[-top.second];
+        result[wc].push_back(node);
+
+        std::pop_heap(worker_heap.begin(), worker_heap.end());
+        worker_heap.back().first -= node->get_n_cpus();
+        if (worker_heap.back().first > 0) {
+            std::push_heap(worker_heap.begin(), worker_heap.end());
+        } else {
+            worker_heap.pop_back();
+        }
+    }
+    return result;
+}
+
+TaskDistribution HeftScheduler::schedule()
+{
+    TaskDistribution result;
+
+    auto &pending = cstate.get_pending_tasks();
+    if (pending.empty()) {
+        return result;
+    }
+
+    size_t total_free_cpus;
+    size_t total_cpus;
+    std::vector<WorkerConnection*> workers = init_workers(total_free_cpus, total_cpus);
+    if (total_free_cpus == 0) {
+        return result;
+    }
+
+    // Time (ms from now) when transfers planned in this round end on a worker
+    std::vector<int64_t> transfers_end(workers.size(), 0);
+
+    // Predicted work (cpus * ms) of running tasks and tasks assigned in this round
+    std::vector<int64_t> work(workers.size());
+    for (WorkerConnection *wc : workers) {
+        work[wc->get_scheduler_index()] = wc->get_running_work();
+    }
+
+    // Ready queue is already ordered by ranks
+    for (TaskNode *node : pending) {
+        int n_cpus = node->get_n_cpus();
+        int64_t duration = cstate.estimate_duration(*node);
+        WorkerConnection *best_wc = nullptr;
+        int64_t best_time = INT64_MAX;
+        int64_t best_data_time = 0;
+
+        for (WorkerConnection *wc : workers) {
+            int free_cpus = wc->get_scheduler_free_cpus();
+            if (free_cpus < n_cpus) {
+                continue;
+            }
+            int index = wc->get_scheduler_index();
+            int64_t missing = 0;
+            for (TaskNode *input_node : node->get_inputs()) {
+                if (input_node->get_worker_status(wc) == TaskStatus::NONE) {
+                    missing += input_node->get_size();
+                }
+            }
+            // The task starts when its inputs are on the worker and the worker
+            // is ready; the ready time spreads the work of the worker on its cpus
+            int64_t data_time = transfers_end[index] + missing / config.transfer_bandwidth;
+            int64_t ready_time = work[index] / std::max(wc->get_resource_cpus(), 1);
+            int64_t time = std::max(data_time, ready_time) + duration;
+            if (time < best_time ||
+                (time == best_time && free_cpus > best_wc->get_scheduler_free_cpus())) {
+                best_time = time;
+                best_data_time = data_time;
+                best_wc = wc;
+            }
+        }
+
+        if (best_wc == nullptr) {
+            continue;
+        }
+        result[best_wc].push_back(node);
+        int best_index = best_wc->get_scheduler_index();
+        transfers_end[best_index] = best_data_time;
+        work[best_index] += duration * n_cpus;
+        best_wc->set_scheduler_free_cpus(best_wc->get_scheduler_free_cpus() - n_cpus);
+
+        total_free_cpus -= n_cpus;
+        if (total_free_cpus == 0) {
+            break;
+        }
+    }
+    return result;
+}
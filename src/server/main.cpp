@@ -4,10 +4,12 @@
 #include <argp.h>
 
 struct Config {
-    Config() : port(9010), debug(false) {}
+    Config() : port(9010), debug(false), scheduler("locality") {}
 
     int port;
     bool debug;
+    std::string scheduler;
+    SchedulerConfig scheduler_config;
 };
 
 
@@ -23,6 +25,17 @@ parse_opt (int key, char *arg,
         config->debug = true;
         break;
 
+    case 's':
+        config->scheduler = arg;
+        break;
+
+    case 301:
+        if (!config->scheduler_config.set(arg)) {
+            fprintf(stderr, "Invalid scheduler option '%s'\n", arg);
+            exit(1);
+        }
+        break;
+
     case 'p':
         config->port = atoi(arg);
         if (config->port <= 0 || config->port > 65535) {
@@ -38,6 +51,8 @@ int parse_args(int argc, char **argv, Config *config)
     struct argp_option options[] = {
         { "debug", 300, 0, 0, "Debug mode"},
         { "port", 'p', "NUMBER", 0, "Listen port for server (default: 9010)"},
+        { "scheduler", 's', "NAME", 0, "Scheduler: locality, fifo, heft (default: locality)"},
+        { "sched-opt", 301, "NAME=VALUE", 0, "Set scheduler parameter (can be used more times)"},
         { 0 }
     };
     struct argp argp = { options, parse_opt };
@@ -62,6 +77,10 @@ int main(int argc, char **argv)
     uv_loop_t loop;
     uv_loop_init(&loop);
     Server server(&loop, config.port);
+    if (!server.get_task_manager().set_scheduler(config.scheduler, config.scheduler_config)) {
+        fprintf(stderr, "Unknown scheduler '%s'\n", config.scheduler.c_str());
+        exit(1);
+    }
     uv_run(&loop, UV_RUN_DEFAULT);
     uv_loop_close(&loop);
     return 0;
@@ -0,0 +1,71 @@
+#ifndef LOOM_SERVER_READYQUEUE_H
+#define LOOM_SERVER_READYQUEUE_H
+
+#include "tasknode.h"
+
+#include <set>
+
+/** Tasks that are ready to be scheduled, ordered by their priority;
+ *  the highest rank first, ties are broken by lower id.
+ *  Ranks are a part of the key, hence a rank of a node in the queue can be
+ *  changed only through update_rank */
+class ReadyQueue {
+
+    struct Compare {
+        bool operator()(const TaskNode *a, const TaskNode *b) const {
+            return a->get_rank() > b->get_rank() ||
+                   (a->get_rank() == b->get_rank() && a->get_id() < b->get_id());
+        }
+    };
+
+    using NodeSet = std::set<TaskNode*, Compare>;
+
+public:
+    using const_iterator = NodeSet::const_iterator;
+
+    void insert(TaskNode *node) {
+        nodes.insert(node);
+    }
+
+    /** Returns false if the node was not in the queue */
+    bool erase(TaskNode *node) {
+        return nodes.erase(node) > 0;
+    }
+
+    bool contains(TaskNode *node) const {
+        return nodes.find(node) != nodes.end();
+    }
+
+    void update_rank(TaskNode *node, int64_t rank) {
+        bool queued = erase(node);
+        node->set_rank(rank);
+        if (queued) {
+            insert(node);
+        }
+    }
+
+    const_iterator begin() const {
+        return nodes.begin();
+    }
+
+    const_iterator end() const {
+        return nodes.end();
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    void clear() {
+        nodes.clear();
+    }
+
+private:
+    NodeSet nodes;
+};
+
+#endif // LOOM_SERVER_READYQUEUE_H
@@ -2,33 +2,121 @@
 #include "scheduler.h"
 #include "workerconn.h"
 #include "server.h"
+#include "scorekernels.h"
+#include "workpool.h"
 
 #include "libloom/compat.h"
 #include "libloom/log.h"
 
+#include <algorithm>
 #include <sstream>
+#include <errno.h>
+#include <stdlib.h>
 
 
-using Score = int64_t;
+using Score = Scheduler::Score;
 static constexpr Score SCORE_MIN = INT64_MIN;
 static constexpr Score UNIT_RECOMPUTE = INT64_MAX;
 
-static constexpr size_t MIN_SCHEDULED_TASKS_LIMIT = 128;
+static constexpr size_t PARALLEL_CHUNK_SIZE = 64; // rows
+static constexpr size_t MAX_AUTO_THREADS = 8;
+
+SchedulerConfig::SchedulerConfig()
+    : min_scheduled_tasks_limit(128),
+      overbooking_limit(8),
+      overbooking_factor(3),
+      input_update_limit(32),
+      next_explore_limit(8),
+      next_update_limit(12),
+      next_size_factor(8),
+      next_size_limit(5 << 20), // 5 MB
+      bonus_per_extra_cpu(150 << 20), // 150 MB
+      bonus_per_next(250000),
+      bonus_per_rank(5000), // per ms of the critical path
+      rank_bonus_limit(50 << 20), // 50 MB
+      transfer_bandwidth(100 << 10), // 100 KB/ms ~ 100 MB/s
+      n_threads(0), // 0 = by number of cores
+      parallel_limit(512)
+{
 
-static constexpr size_t OVERBOOKING_LIMIT = 8;
-static constexpr size_t OVERBOOKING_FACTOR = 3;
+}
 
-static constexpr size_t INPUT_UPDATE_LIMIT = 32;
+// Options; exactly one of the fields is used
+struct ConfigField {
+    const char *name;
+    size_t SchedulerConfig::*size_field;
+    int64_t SchedulerConfig::*score_field;
+    bool nonzero; // Value is used as a divisor or a factor
+};
 
-static constexpr size_t DEFAULT_EXPECTED_SIZE = 5 << 20; // 5 MB
-static constexpr size_t NEXT_EXPLORE_LIMIT = 8;
-static constexpr size_t NEXT_UPDATE_LIMIT = 12;
+static const ConfigField CONFIG_FIELDS[] = {
+    { "min_scheduled_tasks_limit", &SchedulerConfig::min_scheduled_tasks_limit, nullptr, false },
+    { "overbooking_limit", &SchedulerConfig::overbooking_limit, nullptr, false },
+    { "overbooking_factor", &SchedulerConfig::overbooking_factor, nullptr, true },
+    { "input_update_limit", &SchedulerConfig::input_update_limit, nullptr, false },
+    { "next_explore_limit", &SchedulerConfig::next_explore_limit, nullptr, false },
+    { "next_update_limit", &SchedulerConfig::next_update_limit, nullptr, false },
+    { "next_size_factor", nullptr, &SchedulerConfig::next_size_factor, true },
+    { "next_size_limit", nullptr, &SchedulerConfig::next_size_limit, false },
+    { "bonus_per_extra_cpu", nullptr, &SchedulerConfig::bonus_per_extra_cpu, false },
+    { "bonus_per_next", nullptr, &SchedulerConfig::bonus_per_next, false },
+    { "bonus_per_rank", nullptr, &SchedulerConfig::bonus_per_rank, false },
+    { "rank_bonus_limit", nullptr, &SchedulerConfig::rank_bonus_limit, false },
+    { "transfer_bandwidth", nullptr, &SchedulerConfig::transfer_bandwidth, true },
+    { "n_threads", &SchedulerConfig::n_threads, nullptr, false },
+    { "parallel_limit", &SchedulerConfig::parallel_limit, nullptr, false },
+};
 
-static constexpr Score NEXT_SIZE_FACTOR = 8;
-static constexpr Score NEXT_SIZE_LIMIT = 5 << 20; // 5 MB
+bool SchedulerConfig::set(const std::string &option)
+{
+    size_t pos = option.find('=');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::string name = option.substr(0, pos);
+    std::string value = option.substr(pos + 1);
+
+    char *end;
+    errno = 0;
+    long long v = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno != 0 || v < 0) {
+        return false;
+    }
 
-static constexpr Score BONUS_PER_EXTRA_CPU = 150 << 20; // 1MB
-static constexpr Score BONUS_PER_NEXT = 250000;
+    for (const ConfigField &field : CONFIG_FIELDS) {
+        if (name == field.name) {
+            if (field.nonzero && v == 0) {
+                return false;
+            }
+            if (field.size_field) {
+                this->*field.size_field = v;
+            } else {
+                this->*field.score_field = v;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string SchedulerConfig::to_string() const
+{
+    std::stringstream s;
+    bool first = true;
+    for (const ConfigField &field : CONFIG_FIELDS) {
+        if (!first) {
+            s << " ";
+        }
+        first = false;
+        s << field.name << "=";
+        if (field.size_field) {
+            s << this->*field.size_field;
+        } else {
+            s << this->*field.score_field;
+        }
+    }
+    return s.str();
+}
 
 struct Worker {
     WorkerConnection *wc;
@@ -41,49 +129,86 @@ struct WSPair {
 };
 
 struct SUnit {
-    TaskNode *node;
+    TaskNode *node; // nullptr when the unit was already scheduled or dropped
     WorkerConnection *wc;
     Score score;
     int index;
+    size_t row; // offset of the score row
+    unsigned version;
 };
 
 struct SContext {
     size_t worker_size;
     std::vector<WorkerConnection*> workers;
-    std::unordered_map<loom::base::Id, SUnit> units;
-    std::unique_ptr<Score[]> score_table;
+    std::vector<int> free_cpus; // indexed by scheduler index of workers
+    std::vector<int> scheduler_indices; // indexed by worker index, -1 for skipped workers
+    std::vector<SUnit> units; // indexed by SUnit::index
+    std::unordered_map<loom::base::Id, int> unit_indices;
+    Score *score_table;
+
+    // Boosts made during the round; they are reverted at the end of the round
+    std::vector<std::pair<size_t, Score>> boosts;
+
+    SUnit* find_unit(loom::base::Id id) {
+        auto it = unit_indices.find(id);
+        if (it == unit_indices.end()) {
+            return nullptr;
+        }
+        SUnit *unit = &units[it->second];
+        return unit->node ? unit : nullptr;
+    }
+
+    Score* get_row(const SUnit &unit) {
+        return score_table + unit.row;
+    }
+
+    bool fits(const SUnit &unit) const {
+        return unit.node->get_n_cpus() <= free_cpus[unit.wc->get_scheduler_index()];
+    }
+
+    void boost(const SUnit &unit, size_t worker_index, Score value) {
+        size_t offset = unit.row + worker_index;
+        score_table[offset] += value;
+        boosts.push_back(std::make_pair(offset, value));
+    }
 };
 
-static inline WSPair find_best(int n_cpus, Score *table, SContext &context)
+static inline uint64_t move_key(loom::base::Id id, int scheduler_index)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(id)) << 32) |
+            static_cast<uint32_t>(scheduler_index);
+}
+
+static inline WSPair find_best(int n_cpus, const Score *table, const SContext &context)
 {
-    WorkerConnection *wc = nullptr;
-    Score score = SCORE_MIN;
     size_t worker_size = context.worker_size;
-    for (size_t i = 0; i < worker_size; i++) {
-        //loom::base::logger->alert("worker={} score={}", workers[i]->get_address(), table[i]);
-        if (table[i] > score && n_cpus <= context.workers[i]->get_scheduler_free_cpus()) {
-            score = table[i];
-            wc = context.workers[i];
-        }
-    }
+    size_t i = score_argmax(table, &context.free_cpus[0], worker_size, n_cpus);
     WSPair p;
-    p.wc = wc;
-    p.score = score;
+    if (i == worker_size) {
+        p.wc = nullptr;
+        p.score = SCORE_MIN;
+    } else {
+        p.wc = context.workers[i];
+        p.score = table[i];
+    }
     return p;
 }
 
-static inline Score score_from_next_size(Score size)
+static inline Score score_from_next_size(Score size, const SchedulerConfig &config)
 {
-    Score score = size / NEXT_SIZE_FACTOR;
-    if (score > NEXT_SIZE_LIMIT) {
-        score = NEXT_SIZE_LIMIT;
+    Score score = size / config.next_size_factor;
+    if (score > config.next_size_limit) {
+        score = config.next_size_limit;
     }
     return score;
 }
 
 static void compute_table(const TaskNode *node,
                           Score *table,
-                          size_t worker_size)
+                          size_t worker_size,
+                          const int *scheduler_indices,
+                          const Estimator &estimator,
+                          const SchedulerConfig &config)
 {
     // In this function we deliberately ignore a situation when a same id
     // is used as input on more positions
@@ -92,36 +217,37 @@ static void compute_table(const TaskNode *node,
 
     // Init variables
     //Score input_size = 0;
-    std::fill(table, table + worker_size, 0);
+    score_fill(table, worker_size, 0);
     Score total_size = 0;
 
     // Collect sizes
     for (const TaskNode *input_node : node->get_inputs()) {
         Score size = input_node->get_size();
         //input_size += size;
-        for (const auto &pair : input_node->get_workers()) {
-            WorkerConnection *wc = pair.first;
-            table[wc->get_scheduler_index()] += size;
-            total_size += size;
+        for (const auto &entry : input_node->get_workers()) {
+            int index = scheduler_indices[entry.index];
+            if (index >= 0) {
+                table[index] += size;
+                total_size += size;
+            }
         }
     }
 
     // Score bonus
     Score score_bonus = -total_size / static_cast<Score>(worker_size);
-    score_bonus += node->get_nexts().size() * BONUS_PER_NEXT;
+    score_bonus += node->get_nexts().size() * config.bonus_per_next;
+    score_bonus += std::min(node->get_rank() * config.bonus_per_rank, config.rank_bonus_limit);
     const int n_cpus = node->get_n_cpus();
     if (n_cpus > 1) {
-        score_bonus += ((n_cpus - 1) * BONUS_PER_EXTRA_CPU);
+        score_bonus += ((n_cpus - 1) * config.bonus_per_extra_cpu);
     }
 
-    for (size_t i = 0; i < worker_size; i++) {
-        table[i] += score_bonus;
-    }
+    score_add(table, worker_size, score_bonus);
 
     // Compute next score
-    if (node->get_nexts().size() <= NEXT_EXPLORE_LIMIT) {
+    if (node->get_nexts().size() <= config.next_explore_limit) {
         for (TaskNode *next_node : node->get_nexts()) {
-            if (next_node->get_inputs().size() > NEXT_EXPLORE_LIMIT) {
+            if (next_node->get_inputs().size() > config.next_explore_limit) {
                 continue;
             }
             for (TaskNode *input_node : next_node->get_inputs()) {
@@ -129,10 +255,22 @@ static void compute_table(const TaskNode *node,
                     continue;
                 }
                 if (input_node->is_computed()) {
-                    Score score = score_from_next_size(input_node->get_size());
-                    for (const auto &pair : input_node->get_workers()) {
-                        WorkerConnection *wc = pair.first;
-                        table[wc->get_scheduler_index()] += score;
+                    Score score = score_from_next_size(input_node->get_size(), config);
+                    for (const auto &entry : input_node->get_workers()) {
+                        int index = scheduler_indices[entry.index];
+                        if (index >= 0) {
+                            table[index] += score;
+                        }
+                    }
+                } else {
+                    // Input is still running; use its predicted size
+                    Score score = score_from_next_size(
+                        estimator.predict_size(input_node->get_task_def().task_type), config);
+                    for (const auto &entry : input_node->get_workers()) {
+                        int index = scheduler_indices[entry.index];
+                        if (entry.status == TaskStatus::RUNNING && index >= 0) {
+                            table[index] += score;
+                        }
                     }
                 }
             }
@@ -140,51 +278,138 @@ static void compute_table(const TaskNode *node,
     }
 }
 
-static inline void init_unit(int index,
-                             TaskNode *node,
+static inline void init_unit(TaskNode *node,
+                             size_t row,
+                             const WSPair &ws_pair,
                              SContext &context)
 {
-    size_t worker_size = context.worker_size;
-    Score *table = context.score_table.get() + index * worker_size;
-    compute_table(node, table, worker_size);
-    /*loom::base::logger->alert("SUNIT {}", node->get_id());
-    for (size_t i = 0; i < worker_size; i++) {
-        loom::base::logger->alert("INIT id={} worker={} score={}", node->get_id(), context.workers[i]->get_address(), table[i]);
-    }*/
-    WSPair ws_pair = find_best(node->get_n_cpus(), table, context);
     if (ws_pair.score != SCORE_MIN) {
         SUnit unit;
         unit.node = node;
         unit.wc = ws_pair.wc;
         unit.score = ws_pair.score;
-        unit.index = index;
-        context.units.emplace(std::make_pair(node->get_id(), std::move(unit)));
+        unit.index = context.units.size();
+        unit.row = row;
+        unit.version = 0;
+        context.unit_indices.emplace(std::make_pair(node->get_id(), unit.index));
+        context.units.push_back(unit);
     }
 }
 
+static inline void rescore_unit(SUnit &unit, SContext &context)
+{
+    WSPair ws_pair = find_best(unit.node->get_n_cpus(), context.get_row(unit), context);
+    unit.wc = ws_pair.wc;
+    unit.score = ws_pair.score;
+    unit.version++;
+}
 
-TaskDistribution schedule(const ComputationState &cstate)
+/** Selects the best unit by a lazily invalidated max-heap.
+ *  Scores of units are only decreased by filling up workers, hence a unit
+ *  is validated (and re-scored if necessary) when it reaches the top. */
+class HeapSelector {
+public:
+    explicit HeapSelector(SContext &context) : context(context) {
+        heap.reserve(context.units.size());
+        for (SUnit &unit : context.units) {
+            push(unit);
+        }
+    }
+
+    void update(SUnit &unit) {
+        push(unit);
+    }
+
+    SUnit* get_best() {
+        while (!heap.empty()) {
+            const Entry &entry = heap.front();
+            SUnit &unit = context.units[entry.index];
+            if (unit.node == nullptr || unit.version != entry.version) {
+                pop();
+                continue;
+            }
+            if (!context.fits(unit)) {
+                pop();
+                rescore_unit(unit, context);
+                push(unit);
+                continue;
+            }
+            return &unit;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Entry {
+        Score score;
+        loom::base::Id id;
+        int index;
+        unsigned version;
+
+        bool operator<(const Entry &other) const {
+            return score < other.score || (score == other.score && id > other.id);
+        }
+    };
+
+    void push(SUnit &unit) {
+        if (unit.score == SCORE_MIN) {
+            return;
+        }
+        Entry entry;
+        entry.score = unit.score;
+        entry.id = unit.node->get_id();
+        entry.index = unit.index;
+        entry.version = unit.version;
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    void pop() {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+    }
+
+    SContext &context;
+    std::vector<Entry> heap;
+};
+
+static inline void mark_unit_dirty(SUnit &unit, std::vector<SUnit*> &dirty)
 {
-    TaskDistribution result;
+    if (unit.score != UNIT_RECOMPUTE) {
+        unit.score = UNIT_RECOMPUTE;
+        dirty.push_back(&unit);
+    }
+}
 
-    // Init workers
-    auto &worker_conns = cstate.get_server().get_workers();
-    size_t worker_size = worker_conns.size();
-    if (worker_size == 0 ||
-            cstate.get_pending_tasks().size() == 0) {
-        return result;
+std::unique_ptr<Scheduler> Scheduler::create(const std::string &name,
+                                             const ComputationState &cstate,
+                                             const SchedulerConfig &config)
+{
+    if (name == "locality") {
+        return std::make_unique<LocalityScheduler>(cstate, config);
+    }
+    if (name == "fifo") {
+        return std::make_unique<FifoScheduler>(cstate, config);
+    }
+    if (name == "heft") {
+        return std::make_unique<HeftScheduler>(cstate, config);
     }
+    return nullptr;
+}
 
-    SContext context;
-    context.workers.reserve(worker_size);
+std::vector<WorkerConnection*> Scheduler::init_workers(size_t &total_free_cpus,
+                                                       size_t &total_cpus)
+{
+    std::vector<WorkerConnection*> workers;
+    total_free_cpus = 0;
+    total_cpus = 0;
 
-    int index = 0;
-    size_t total_free_cpus = 0;
-    size_t total_cpus = 0;
+    auto &worker_conns = cstate.get_server().get_workers();
+    workers.reserve(worker_conns.size());
 
+    int index = 0;
     for (auto &wc : worker_conns) {
-       if (unlikely(wc->is_blocked())) {
-          worker_size--;
+       if (unlikely(wc->is_blocked() || wc->is_congested())) {
           continue;
        }
        total_cpus += wc->get_resource_cpus();
@@ -192,64 +417,345 @@ TaskDistribution schedule(const ComputationState &cstate)
        total_free_cpus += free_cpus;
        wc->set_scheduler_index(index++);
        wc->set_scheduler_free_cpus(free_cpus);
-       context.workers.push_back(wc.get());
+       workers.push_back(wc.get());
     }
+    return workers;
+}
 
-    if (worker_size == 0) {
-       return result;
+LocalityScheduler::LocalityScheduler(const ComputationState &cstate,
+                                     const SchedulerConfig &config)
+    : Scheduler(cstate, config), n_recomputed(0), n_threads(config.n_threads)
+{
+    if (n_threads == 0) {
+        n_threads = std::min<size_t>(std::thread::hardware_concurrency(), MAX_AUTO_THREADS);
+    }
+}
+
+LocalityScheduler::~LocalityScheduler()
+{
+
+}
+
+void LocalityScheduler::update_workers(SContext &context)
+{
+    if (workers != context.workers) {
+        // A worker was added or removed, all rows are invalid
+        clear();
+        workers = context.workers;
+    }
+}
+
+LocalityScheduler::ScoreRow& LocalityScheduler::get_score_row(const TaskNode *node)
+{
+    auto it = rows.find(node);
+    if (it != rows.end()) {
+        return it->second;
+    }
+    ScoreRow row;
+    if (free_rows.empty()) {
+        row.offset = row_storage.size();
+        row_storage.resize(row_storage.size() + workers.size());
+    } else {
+        row.offset = free_rows.back();
+        free_rows.pop_back();
+    }
+    row.dirty = true;
+    row.used = false;
+    return rows.emplace(std::make_pair(node, row)).first->second;
+}
+
+void LocalityScheduler::release_unused_rows()
+{
+    auto it = rows.begin();
+    while (it != rows.end()) {
+        if (!it->second.used) {
+            free_rows.push_back(it->second.offset);
+            it = rows.erase(it);
+        } else {
+            it->second.used = false;
+            ++it;
+        }
+    }
+}
+
+void LocalityScheduler::mark_dirty(const TaskNode *node)
+{
+    auto it = rows.find(node);
+    if (it != rows.end()) {
+        it->second.dirty = true;
+    }
+}
+
+void LocalityScheduler::data_changed(const TaskNode &node)
+{
+    if (rows.empty()) {
+        return;
+    }
+    if (node.get_nexts().size() > rows.size()) {
+        // It is cheaper to recompute everything
+        invalidate_all();
+        return;
+    }
+    // Rows of consumers and rows of tasks that shares a consumer with the node
+    // (see the "next score" in compute_table)
+    for (TaskNode *next_node : node.get_nexts()) {
+        mark_dirty(next_node);
+        if (next_node->get_inputs().size() > config.next_explore_limit) {
+            continue;
+        }
+        for (TaskNode *input_node : next_node->get_inputs()) {
+            if (input_node != &node) {
+                mark_dirty(input_node);
+            }
+        }
+    }
+}
+
+void LocalityScheduler::invalidate_all()
+{
+    for (auto &pair : rows) {
+        pair.second.dirty = true;
+    }
+}
+
+void LocalityScheduler::clear()
+{
+    rows.clear();
+    row_storage.clear();
+    free_rows.clear();
+}
+
+bool LocalityScheduler::init_round(SContext &context)
+{
+    if (cstate.get_pending_tasks().size() == 0) {
+        return false;
+    }
+
+    // Init workers; columns of score rows are indexed by worker indices,
+    // so rows stay valid when workers are blocked or congested. Such workers
+    // are skipped only by selection, they have no free cpus (-1)
+    size_t total_free_cpus = 0;
+    size_t total_cpus = 0;
+    size_t n_usable = 0;
+    auto &worker_conns = cstate.get_server().get_workers();
+    size_t worker_size = 0;
+    for (auto &wc : worker_conns) {
+        worker_size = std::max<size_t>(worker_size, wc->get_worker_index() + 1);
+    }
+    context.workers.assign(worker_size, nullptr);
+    context.free_cpus.assign(worker_size, -1);
+    context.scheduler_indices.assign(worker_size, -1);
+    for (auto &wc : worker_conns) {
+        int index = wc->get_worker_index();
+        context.workers[index] = wc.get();
+        context.scheduler_indices[index] = index;
+        wc->set_scheduler_index(index);
+        if (unlikely(wc->is_blocked() || wc->is_congested())) {
+            continue;
+        }
+        total_cpus += wc->get_resource_cpus();
+        int free_cpus = wc->get_free_cpus();
+        total_free_cpus += free_cpus;
+        wc->set_scheduler_free_cpus(free_cpus);
+        context.free_cpus[index] = free_cpus;
+        n_usable++;
+    }
+
+    if (n_usable == 0) {
+       return false;
     }
 
     context.worker_size = worker_size;
+    update_workers(context);
 
     size_t ptasks_size = cstate.get_pending_tasks().size();
 
-    if (ptasks_size > (total_cpus + 1) * OVERBOOKING_LIMIT) {
-        for (auto &wc : context.workers) {
-            auto free_cpus = wc->get_scheduler_free_cpus();
-            free_cpus += wc->get_resource_cpus() * (OVERBOOKING_FACTOR - 1);
-            wc->set_scheduler_free_cpus(free_cpus);
+    if (ptasks_size > (total_cpus + 1) * config.overbooking_limit) {
+        for (size_t i = 0; i < worker_size; i++) {
+            if (context.free_cpus[i] >= 0) {
+                context.free_cpus[i] += context.workers[i]->get_resource_cpus() * (config.overbooking_factor - 1);
+            }
         }
-        total_free_cpus += (OVERBOOKING_FACTOR - 1) * total_cpus;
+        total_free_cpus += (config.overbooking_factor - 1) * total_cpus;
     }
 
     size_t limit = total_free_cpus * 5 + total_cpus;
-    if (limit < MIN_SCHEDULED_TASKS_LIMIT) {
-        limit = MIN_SCHEDULED_TASKS_LIMIT;
+    if (limit < config.min_scheduled_tasks_limit) {
+        limit = config.min_scheduled_tasks_limit;
     }
 
-    std::vector<std::unordered_set<loom::base::Id>> scheduled_moves(worker_size);
-
     loom::base::logger->debug("Scheduler: {} pending task(s) on {} worker(s) / free_cpus={}",
                               cstate.get_pending_tasks().size(),
-                              worker_size, total_free_cpus);
+                              n_usable, total_free_cpus);
+
+    // Select candidates; limit number of tasks on the longest paths,
+    // i.e. the top of the ready queue
+    std::vector<TaskNode*> nodes;
+    nodes.reserve(std::min(ptasks_size, limit));
+    for (TaskNode *node : cstate.get_pending_tasks()) {
+        if (nodes.size() == limit) {
+            break;
+        }
+        nodes.push_back(node);
+    }
 
-    // Init units
+    // Init rows; all rows has to be allocated before we take pointer into row_storage
+    std::vector<ScoreRow*> node_rows;
+    node_rows.reserve(nodes.size());
+    for (TaskNode *node : nodes) {
+        ScoreRow &row = get_score_row(node);
+        row.used = true;
+        node_rows.push_back(&row);
+    }
+    context.score_table = &row_storage[0];
+
+    // Compute dirty rows and the best worker for each row;
+    // rows are disjoint and everything else is only read, so it runs in parallel
+    std::vector<WSPair> best_pairs(nodes.size());
+    std::atomic<size_t> n_computed(0);
+    const Estimator &estimator = cstate.get_estimator();
+    auto score_rows = [&](size_t begin, size_t end) {
+        size_t computed = 0;
+        for (size_t i = begin; i < end; i++) {
+            ScoreRow &row = *node_rows[i];
+            Score *table = context.score_table + row.offset;
+            if (row.dirty) {
+                compute_table(nodes[i], table, worker_size,
+                              &context.scheduler_indices[0], estimator, config);
+                row.dirty = false;
+                computed++;
+            }
+            best_pairs[i] = find_best(nodes[i]->get_n_cpus(), table, context);
+        }
+        n_computed += computed;
+    };
+    if (n_threads > 1 && nodes.size() >= config.parallel_limit) {
+        // Threads are started by the first round that is big enough,
+        // schedulers of small computations never start them
+        if (!pool) {
+            pool = std::make_unique<WorkPool>(n_threads);
+        }
+        pool->parallel_for(nodes.size(), PARALLEL_CHUNK_SIZE, score_rows);
+    } else {
+        score_rows(0, nodes.size());
+    }
+
+    // Init units; it is serial, so units have always the same order
+    context.units.reserve(nodes.size());
+    context.unit_indices.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        init_unit(nodes[i], node_rows[i]->offset, best_pairs[i], context);
+    }
+
+    n_recomputed = n_computed;
+    loom::base::logger->debug("Scheduler: {} of {} row(s) recomputed", n_recomputed, nodes.size());
+    return true;
+}
+
+TaskDistribution LocalityScheduler::schedule()
+{
+    TaskDistribution result;
+    SContext context;
+    if (!init_round(context)) {
+        return result;
+    }
 
+    // Inputs already planned to be moved in this round; keys are (id, scheduler index)
+    std::unordered_set<uint64_t> scheduled_moves;
+    HeapSelector selector(context);
+    std::vector<SUnit*> dirty;
 
-    if (ptasks_size <= limit) {
-        context.units.reserve(ptasks_size);
-        context.score_table = std::make_unique<Score[]>(worker_size * ptasks_size);
-        index = 0;
-        for (TaskNode* node: cstate.get_pending_tasks()) {
-            init_unit(index, node, context);
-            index++;
+    for(;;) {
+        SUnit *best_unit = selector.get_best();
+        if (best_unit == nullptr) {
+            break;
+        }
+
+        TaskNode *best_node = best_unit->node;
+        WorkerConnection *best_wc = best_unit->wc;
+        auto n_cpus = best_node->get_n_cpus();
+        assert(best_wc);
+
+        // The best unit is not needed anymore; the task leaves the pending set
+        best_unit->node = nullptr;
+        rows[best_node].used = false;
+
+        //loom::base::logger->alert(">> SELECTED id={} worker={} score={}", id, best_wc->get_address(), best_score);
+        result[best_wc].push_back(best_node);
+        const int best_index = best_wc->get_scheduler_index();
+        context.free_cpus[best_index] -= n_cpus;
+
+        if (best_node->get_inputs().size() <= config.input_update_limit)
+        {
+            for (TaskNode *input_node : best_node->get_inputs()) {
+                if (// Check update limit
+                    input_node->get_nexts().size() > config.input_update_limit ||
+                    // Check that the input was ok
+                    input_node->get_workers().get(best_wc->get_worker_index()) != TaskStatus::NONE ||
+                    // Check that we did not already planned the node
+                    !scheduled_moves.insert(move_key(input_node->get_id(), best_index)).second) {
+                    continue;
+                }
+                Score size = input_node->get_size();
+                for (TaskNode *next_node : input_node->get_nexts()) {
+                    SUnit *unit = context.find_unit(next_node->get_id());
+                    if (unit == nullptr) {
+                        continue;
+                    }
+                    mark_unit_dirty(*unit, dirty);
+                    //loom::base::logger->alert("BOOSTING id={} worker={}", unit.node->get_id(), best_wc->get_address());
+                    context.boost(*unit, best_index, size);
+                }
+            }
         }
-    } else { // pick limit number of tasks with lowest ids
-        std::vector<TaskNode*> nodes;
-        nodes.reserve(ptasks_size);
-        for (TaskNode *node : cstate.get_pending_tasks()) {
-            nodes.push_back(node);
+
+
+        if (best_node->get_nexts().size() <= config.next_update_limit)
+        {
+            for (TaskNode *next_node : best_node->get_nexts()) {
+                if (next_node->get_inputs().size() > config.next_update_limit) {
+                    continue;
+                }
+                for (TaskNode *input_node : next_node->get_inputs()) {
+                    if (input_node == best_node || input_node->is_computed()) {
+                        continue;
+                    }
+                    SUnit *unit = context.find_unit(input_node->get_id());
+                    if (unit == nullptr) {
+                        continue;
+                    }
+                    mark_unit_dirty(*unit, dirty);
+                    //loom::base::logger->alert("BOOSTING id={} worker={}", unit.node->get_id(), best_wc->get_address());
+                    context.boost(*unit, best_index, config.next_size_limit);
+                }
+            }
         }
-        std::nth_element(nodes.begin(), nodes.begin() + limit, nodes.end(),
-                         [](const TaskNode *a, const TaskNode *b) { return a->get_id() < b->get_id(); });
 
-        context.units.reserve(limit);
-        context.score_table = std::make_unique<Score[]>(worker_size * limit);
-        for (index = 0; index < static_cast<int>(limit); index++) {
-            init_unit(index, nodes[index], context);
+        for (SUnit *unit : dirty) {
+            rescore_unit(*unit, context);
+            selector.update(*unit);
         }
+        dirty.clear();
+    }
+
+    end_round(context);
+    return result;
+}
+
+TaskDistribution LocalityScheduler::schedule_reference()
+{
+    TaskDistribution result;
+    SContext context;
+    if (!init_round(context)) {
+        return result;
     }
 
+    // The selection loop of the original schedule(); the only change in the
+    // selection is that ties of scores are broken by task ids (the original
+    // took the first unit in the order of a hash map). Data structures
+    // follow SContext and boosts are reverted at the end of the round.
+    std::vector<std::unordered_set<loom::base::Id>> scheduled_moves(context.worker_size);
+
     // Just create an pointer that does not definitely point to a valid WorkerConnection
     WorkerConnection *invalid_ptr = reinterpret_cast<WorkerConnection*>(&invalid_ptr);
     WorkerConnection *last_changed = invalid_ptr;
@@ -257,111 +763,126 @@ TaskDistribution schedule(const ComputationState &cstate)
     for(;;) {
         Score best_score = SCORE_MIN;
         WorkerConnection *best_wc = nullptr;
-        TaskNode *best_node = nullptr;
+        SUnit *best_unit = nullptr;
 
-        for (auto &pair : context.units) {
-            SUnit &unit = pair.second;
+        for (SUnit &unit : context.units) {
             TaskNode *node = unit.node;
+            if (node == nullptr) {
+                continue;
+            }
 
             if (unit.score == UNIT_RECOMPUTE ||
-                    (last_changed == unit.wc && unit.wc->get_scheduler_free_cpus() < node->get_n_cpus())) {
-                Score *table = context.score_table.get() + unit.index * worker_size;
-                WSPair ws_pair = find_best(node->get_n_cpus(), table, context);
+                    (last_changed == unit.wc && !context.fits(unit))) {
+                WSPair ws_pair = find_best(node->get_n_cpus(), context.get_row(unit), context);
                 unit.wc = ws_pair.wc;
                 unit.score = ws_pair.score;
             }
 
-            //loom::base::logger->alert("UNIT id={} worker={} score={}", unit.node->get_id(), unit.wc?unit.wc->get_address():"none", unit.score);
-            if (unit.score > best_score) {
+            if (unit.score > best_score ||
+                    (unit.score == best_score && best_unit &&
+                     node->get_id() < best_unit->node->get_id())) {
                 best_score = unit.score;
                 best_wc = unit.wc;
-                best_node = node;
+                best_unit = &unit;
             }
         }
 
-        if (best_score != SCORE_MIN) {
-            auto n_cpus = best_node->get_n_cpus();
-            auto id = best_node->get_id();
-
-            if (best_wc == nullptr) {
-                std::sort(context.workers.begin(), context.workers.end(),
-                          [](WorkerConnection *a, WorkerConnection *b)
-                            { return a->get_scheduler_free_cpus() > b->get_scheduler_free_cpus(); });
-                if (context.workers[0]->get_scheduler_free_cpus() < n_cpus) {
-                    auto it = context.units.find(id);
-                    assert(it != context.units.end());
-                    context.units.erase(it);
+        if (best_score == SCORE_MIN) {
+            break;
+        }
+
+        // Units always have a worker with enough free cpus (see find_best)
+        assert(best_wc);
+        TaskNode *best_node = best_unit->node;
+        auto n_cpus = best_node->get_n_cpus();
+        const int best_index = best_wc->get_scheduler_index();
+
+        result[best_wc].push_back(best_node);
+        context.free_cpus[best_index] -= n_cpus;
+        if (n_cpus > 0) {
+            last_changed = best_wc;
+        } else {
+            last_changed = invalid_ptr;
+        }
+
+        if (best_node->get_inputs().size() <= config.input_update_limit)
+        {
+            for (TaskNode *input_node : best_node->get_inputs()) {
+                if (// Check update limit
+                    input_node->get_nexts().size() > config.input_update_limit ||
+                    // Check that the input was ok
+                    input_node->get_worker_status(best_wc) != TaskStatus::NONE ||
+                    // Check that we did not already planned the node
+                    scheduled_moves[best_index].find(input_node->get_id()) \
+                        != scheduled_moves[best_index].end()) {
                     continue;
                 }
-                best_wc = context.workers[0];
-            }
-            //loom::base::logger->alert(">> SELECTED id={} worker={} score={}", id, best_wc->get_address(), best_score);
-            result[best_wc].push_back(best_node);
-            best_wc->set_scheduler_free_cpus(best_wc->get_scheduler_free_cpus() - n_cpus);
-            if (n_cpus > 0) {
-                last_changed = best_wc;
-            } else {
-                last_changed = invalid_ptr;
-            }
-
-            if (best_node->get_inputs().size() <= INPUT_UPDATE_LIMIT)
-            {
-                for (TaskNode *input_node : best_node->get_inputs()) {
-                    if (// Check update limit
-                        input_node->get_nexts().size() > INPUT_UPDATE_LIMIT ||
-                        // Check that the input was ok
-                        input_node->get_worker_status(best_wc) != TaskStatus::NONE||
-                        // Check that we did not already planned the node
-                        scheduled_moves[best_wc->get_scheduler_index()].find(input_node->get_id()) \
-                            != scheduled_moves[best_wc->get_scheduler_index()].end()) {
+                scheduled_moves[best_index].insert(input_node->get_id());
+                Score size = input_node->get_size();
+                for (TaskNode *next_node : input_node->get_nexts()) {
+                    SUnit *unit = context.find_unit(next_node->get_id());
+                    if (unit == nullptr) {
                         continue;
                     }
-                    scheduled_moves[best_wc->get_scheduler_index()].insert(input_node->get_id());
-                    Score size = input_node->get_size();
-                    for (TaskNode *next_node : input_node->get_nexts()) {
-                        auto it = context.units.find(next_node->get_id());
-                        if (it == context.units.end()) {
-                            continue;
-                        }
-                        SUnit &unit = it->second;
-                        unit.score = UNIT_RECOMPUTE;
-                        Score *table = context.score_table.get() + unit.index * worker_size;
-                        //loom::base::logger->alert("BOOSTING id={} worker={}", unit.node->get_id(), best_wc->get_address());
-                        table[best_wc->get_scheduler_index()] += size;
-                    }
+                    unit->score = UNIT_RECOMPUTE;
+                    context.boost(*unit, best_index, size);
                 }
             }
+        }
 
-
-            if (best_node->get_nexts().size() <= NEXT_UPDATE_LIMIT)
-            {
-                for (TaskNode *next_node : best_node->get_nexts()) {
-                    if (next_node->get_inputs().size() > NEXT_UPDATE_LIMIT) {
+        if (best_node->get_nexts().size() <= config.next_update_limit)
+        {
+            for (TaskNode *next_node : best_node->get_nexts()) {
+                if (next_node->get_inputs().size() > config.next_update_limit) {
+                    continue;
+                }
+                for (TaskNode *input_node : next_node->get_inputs()) {
+                    if (input_node == best_node || input_node->is_computed()) {
                         continue;
                     }
-                    for (TaskNode *input_node : next_node->get_inputs()) {
-                        if (input_node == best_node || input_node->is_computed()) {
-                            continue;
-                        }
-                        auto it = context.units.find(input_node->get_id());
-                        if (it == context.units.end()) {
-                            continue;
-                        }
-                        SUnit &unit = it->second;
-                        unit.score = UNIT_RECOMPUTE;
-                        Score *table = context.score_table.get() + unit.index * worker_size;
-                        //loom::base::logger->alert("BOOSTING id={} worker={}", unit.node->get_id(), best_wc->get_address());
-                        table[best_wc->get_scheduler_index()] += NEXT_SIZE_LIMIT;
+                    SUnit *unit = context.find_unit(input_node->get_id());
+                    if (unit == nullptr) {
+                        continue;
                     }
+                    unit->score = UNIT_RECOMPUTE;
+                    context.boost(*unit, best_index, config.next_size_limit);
                 }
             }
-
-            auto it = context.units.find(id);
-            assert(it != context.units.end());
-            context.units.erase(it);
-        } else {
-            break;
         }
+
+        best_unit->node = nullptr;
+        rows[best_node].used = false;
     }
+
+    end_round(context);
     return result;
 }
+
+void LocalityScheduler::end_round(SContext &context)
+{
+    // Revert boosts, they are valid only for this round
+    for (auto &pair : context.boosts) {
+        context.score_table[pair.first] -= pair.second;
+    }
+    release_unused_rows();
+}
+
+// One-shot schedulers are serial, threads would live only for one round
+static SchedulerConfig one_shot_config()
+{
+    SchedulerConfig config;
+    config.n_threads = 1;
+    return config;
+}
+
+TaskDistribution schedule(const ComputationState &cstate)
+{
+    LocalityScheduler scheduler(cstate, one_shot_config());
+    return scheduler.schedule();
+}
+
+TaskDistribution schedule_reference(const ComputationState &cstate)
+{
+    LocalityScheduler scheduler(cstate, one_shot_config());
+    return scheduler.schedule_reference();
+}
@@ -3,7 +3,187 @@
 
 #include "compstate.h"
 
+#include <memory>
+#include <string>
+#include <stdint.h>
+
 using TaskDistribution = std::unordered_map<WorkerConnection*, std::vector<TaskNode*>>;
+
+struct SContext;
+class WorkPool;
+
+/** Tunable parameters of schedulers; they can be changed at server start
+ *  by "name=value" options (see SchedulerConfig::set) */
+struct SchedulerConfig {
+    SchedulerConfig();
+
+    /** Parses "name=value", returns false when name or value is invalid */
+    bool set(const std::string &option);
+
+    std::string to_string() const;
+
+    // Limits
+    size_t min_scheduled_tasks_limit;
+    size_t overbooking_limit;
+    size_t overbooking_factor;
+    size_t input_update_limit;
+    size_t next_explore_limit;
+    size_t next_update_limit;
+
+    // Scores
+    int64_t next_size_factor;
+    int64_t next_size_limit;
+    int64_t bonus_per_extra_cpu;
+    int64_t bonus_per_next;
+    int64_t bonus_per_rank;
+    int64_t rank_bonus_limit;
+
+    // HEFT
+    int64_t transfer_bandwidth; // bytes per ms
+
+    // Threads used for computing rows
+    size_t n_threads;
+    size_t parallel_limit; // Minimal number of rows to use threads
+};
+
+/** Interface of scheduling policies */
+class Scheduler {
+
+public:
+    using Score = int64_t;
+
+    Scheduler(const ComputationState &cstate, const SchedulerConfig &config)
+        : cstate(cstate), config(config) {}
+    virtual ~Scheduler() {}
+
+    virtual TaskDistribution schedule() = 0;
+
+    /** Placement or state of data object was changed
+     *  (task finished, transfer started/finished, checkpoint loaded) */
+    virtual void data_changed(const TaskNode &node) {}
+
+    /** Something that cannot be tracked by data_changed was changed,
+     *  e.g. a new plan adds nexts to existing nodes */
+    virtual void invalidate_all() {}
+
+    /** Forget all cached data, has to be called when nodes are removed without scheduling */
+    virtual void clear() {}
+
+    const SchedulerConfig& get_config() const {
+        return config;
+    }
+
+    /** Creates scheduler by name ("locality", "fifo", "heft"),
+     *  returns nullptr for an unknown name */
+    static std::unique_ptr<Scheduler> create(const std::string &name,
+                                             const ComputationState &cstate,
+                                             const SchedulerConfig &config);
+
+protected:
+    /** Sets scheduler indices and scheduler free cpus of workers that are not
+     *  blocked or congested, returns them and the total number of their free cpus */
+    std::vector<WorkerConnection*> init_workers(size_t &total_free_cpus,
+                                                size_t &total_cpus);
+
+    const ComputationState &cstate;
+    const SchedulerConfig config;
+};
+
+/** The default scheduler; places tasks close to their inputs.
+ *  It keeps score rows of pending tasks between scheduling rounds.
+ *  A row is recomputed only when it was invalidated by a change of
+ *  data it depends on (see data_changed) or when the set of workers changes */
+class LocalityScheduler : public Scheduler {
+
+public:
+    explicit LocalityScheduler(const ComputationState &cstate,
+                               const SchedulerConfig &config = SchedulerConfig());
+    ~LocalityScheduler();
+
+    TaskDistribution schedule() override;
+
+    /** The same round as schedule(), but units are selected by the linear
+     *  scan loop of the original scheduler (ties of scores are broken by ids);
+     *  it is slow and it is used only as reference in tests */
+    TaskDistribution schedule_reference();
+
+    void data_changed(const TaskNode &node) override;
+    void invalidate_all() override;
+    void clear() override;
+
+    size_t get_n_rows() const {
+        return rows.size();
+    }
+
+    /** Number of rows recomputed in the last round */
+    size_t get_n_recomputed() const {
+        return n_recomputed;
+    }
+
+    bool has_work_pool() const {
+        return pool != nullptr;
+    }
+
+private:
+    struct ScoreRow {
+        size_t offset;
+        bool dirty;
+        bool used; // Row was a candidate in the current round
+    };
+
+    /** Prepares workers, candidates, score rows and units of a round;
+     *  returns false when there is nothing to schedule */
+    bool init_round(SContext &context);
+    void end_round(SContext &context);
+
+    void mark_dirty(const TaskNode *node);
+    ScoreRow& get_score_row(const TaskNode *node);
+    void release_unused_rows();
+    void update_workers(SContext &context);
+
+    // Columns of score rows, indexed by worker index (nullptr for unused indices)
+    std::vector<WorkerConnection*> workers;
+    std::unordered_map<const TaskNode*, ScoreRow> rows;
+    std::vector<Score> row_storage;
+    std::vector<size_t> free_rows;
+    size_t n_recomputed;
+    size_t n_threads;
+    std::unique_ptr<WorkPool> pool; // Created lazily by the first parallel round
+};
+
+/** Cheap scheduler for big flat workloads; tasks are taken in the order of
+ *  the ready queue (by ranks, that are equal in flat plans, then by ids) and
+ *  each one is placed on the worker with most free cpus.
+ *  Scheduling stops at the first task that does not fit, so later tasks
+ *  never overtake it. Placement of data is ignored */
+class FifoScheduler : public Scheduler {
+
+public:
+    explicit FifoScheduler(const ComputationState &cstate,
+                           const SchedulerConfig &config = SchedulerConfig())
+        : Scheduler(cstate, config) {}
+
+    TaskDistribution schedule() override;
+};
+
+/** HEFT-like list scheduler for small graphs of expensive tasks;
+ *  tasks are taken by their ranks (upward ranks computed from predicted
+ *  durations) and each one is placed on the worker with a free cpu where it
+ *  finishes earliest. The finish time is the predicted duration after the
+ *  later of: the end of transfers of its missing inputs (after transfers
+ *  already planned in this round) and the ready time of the worker, i.e.
+ *  predicted work of its running and already assigned tasks per cpu */
+class HeftScheduler : public Scheduler {
+
+public:
+    explicit HeftScheduler(const ComputationState &cstate,
+                           const SchedulerConfig &config = SchedulerConfig())
+        : Scheduler(cstate, config) {}
+
+    TaskDistribution schedule() override;
+};
+
 TaskDistribution schedule(const ComputationState &cstate);
+TaskDistribution schedule_reference(const ComputationState &cstate);
 
 #endif
@@ -0,0 +1,266 @@
+#include "scorekernels.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LOOM_SCORE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Scalar
+
+static void fill_scalar(int64_t *row, size_t size, int64_t value)
+{
+    for (size_t i = 0; i < size; i++) {
+        row[i] = value;
+    }
+}
+
+static void add_scalar(int64_t *row, size_t size, int64_t value)
+{
+    for (size_t i = 0; i < size; i++) {
+        row[i] += value;
+    }
+}
+
+static size_t argmax_scalar(const int64_t *row, const int *free_cpus, size_t size, int n_cpus)
+{
+    size_t index = size;
+    int64_t score = INT64_MIN;
+    for (size_t i = 0; i < size; i++) {
+        if (row[i] > score && n_cpus <= free_cpus[i]) {
+            score = row[i];
+            index = i;
+        }
+    }
+    return index;
+}
+
+#ifdef LOOM_SCORE_KERNELS_X86
+
+/* Vector versions keep the best score and its index for each lane;
+ * lanes see indices in increasing order and are updated only by a strictly
+ * better score, so the smallest index among equal lane maxima is the
+ * same result as the scalar version gives */
+static size_t argmax_reduce(const int64_t *best, const int64_t *best_index, size_t lanes,
+                            const int64_t *row, const int *free_cpus,
+                            size_t start, size_t size, int n_cpus)
+{
+    size_t index = size;
+    int64_t score = INT64_MIN;
+    for (size_t k = 0; k < lanes; k++) {
+        if (best[k] == INT64_MIN) {
+            continue;
+        }
+        if (best[k] > score ||
+                (best[k] == score && static_cast<size_t>(best_index[k]) < index)) {
+            score = best[k];
+            index = best_index[k];
+        }
+    }
+    for (size_t i = start; i < size; i++) {
+        if (row[i] > score && n_cpus <= free_cpus[i]) {
+            score = row[i];
+            index = i;
+        }
+    }
+    return index;
+}
+
+// SSE4.2 (pcmpgtq)
+
+__attribute__((target("sse4.2")))
+static void fill_sse42(int64_t *row, size_t size, int64_t value)
+{
+    const __m128i v = _mm_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), v);
+    }
+    for (; i < size; i++) {
+        row[i] = value;
+    }
+}
+
+__attribute__((target("sse4.2")))
+static void add_sse42(int64_t *row, size_t size, int64_t value)
+{
+    const __m128i v = _mm_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i *p = reinterpret_cast<__m128i*>(row + i);
+        _mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), v));
+    }
+    for (; i < size; i++) {
+        row[i] += value;
+    }
+}
+
+__attribute__((target("sse4.2")))
+static size_t argmax_sse42(const int64_t *row, const int *free_cpus, size_t size, int n_cpus)
+{
+    const __m128i min_v = _mm_set1_epi64x(INT64_MIN);
+    const __m128i need = _mm_set1_epi32(n_cpus - 1);
+    const __m128i step = _mm_set1_epi64x(2);
+    __m128i best = min_v;
+    __m128i best_index = _mm_setzero_si128();
+    __m128i index = _mm_set_epi64x(1, 0);
+
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128i cpus = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(free_cpus + i));
+        __m128i fits = _mm_cvtepi32_epi64(_mm_cmpgt_epi32(cpus, need));
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        v = _mm_blendv_epi8(min_v, v, fits);
+        __m128i gt = _mm_cmpgt_epi64(v, best);
+        best = _mm_blendv_epi8(best, v, gt);
+        best_index = _mm_blendv_epi8(best_index, index, gt);
+        index = _mm_add_epi64(index, step);
+    }
+
+    int64_t b[2], bi[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(b), best);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bi), best_index);
+    return argmax_reduce(b, bi, 2, row, free_cpus, i, size, n_cpus);
+}
+
+// AVX2
+
+__attribute__((target("avx2")))
+static void fill_avx2(int64_t *row, size_t size, int64_t value)
+{
+    const __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + i), v);
+    }
+    for (; i < size; i++) {
+        row[i] = value;
+    }
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(int64_t *row, size_t size, int64_t value)
+{
+    const __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256i *p = reinterpret_cast<__m256i*>(row + i);
+        _mm256_storeu_si256(p, _mm256_add_epi64(_mm256_loadu_si256(p), v));
+    }
+    for (; i < size; i++) {
+        row[i] += value;
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t argmax_avx2(const int64_t *row, const int *free_cpus, size_t size, int n_cpus)
+{
+    const __m256i min_v = _mm256_set1_epi64x(INT64_MIN);
+    const __m128i need = _mm_set1_epi32(n_cpus - 1);
+    const __m256i step = _mm256_set1_epi64x(4);
+    __m256i best = min_v;
+    __m256i best_index = _mm256_setzero_si256();
+    __m256i index = _mm256_set_epi64x(3, 2, 1, 0);
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128i cpus = _mm_loadu_si128(reinterpret_cast<const __m128i*>(free_cpus + i));
+        __m256i fits = _mm256_cvtepi32_epi64(_mm_cmpgt_epi32(cpus, need));
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        v = _mm256_blendv_epi8(min_v, v, fits);
+        __m256i gt = _mm256_cmpgt_epi64(v, best);
+        best = _mm256_blendv_epi8(best, v, gt);
+        best_index = _mm256_blendv_epi8(best_index, index, gt);
+        index = _mm256_add_epi64(index, step);
+    }
+
+    int64_t b[4], bi[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(b), best);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bi), best_index);
+    return argmax_reduce(b, bi, 4, row, free_cpus, i, size, n_cpus);
+}
+
+#endif // LOOM_SCORE_KERNELS_X86
+
+// Dispatch
+
+struct ScoreKernels {
+    ScoreKernelImpl impl;
+    void (*fill)(int64_t*, size_t, int64_t);
+    void (*add)(int64_t*, size_t, int64_t);
+    size_t (*argmax)(const int64_t*, const int*, size_t, int);
+};
+
+static bool is_supported(ScoreKernelImpl impl)
+{
+    switch (impl) {
+#ifdef LOOM_SCORE_KERNELS_X86
+    case ScoreKernelImpl::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ScoreKernelImpl::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    case ScoreKernelImpl::SCALAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static ScoreKernels make_kernels(ScoreKernelImpl impl)
+{
+    switch (impl) {
+#ifdef LOOM_SCORE_KERNELS_X86
+    case ScoreKernelImpl::AVX2:
+        return { impl, fill_avx2, add_avx2, argmax_avx2 };
+    case ScoreKernelImpl::SSE42:
+        return { impl, fill_sse42, add_sse42, argmax_sse42 };
+#endif
+    default:
+        return { ScoreKernelImpl::SCALAR, fill_scalar, add_scalar, argmax_scalar };
+    }
+}
+
+static ScoreKernels select_kernels()
+{
+#ifdef LOOM_SCORE_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+    if (is_supported(ScoreKernelImpl::AVX2)) {
+        return make_kernels(ScoreKernelImpl::AVX2);
+    }
+    if (is_supported(ScoreKernelImpl::SSE42)) {
+        return make_kernels(ScoreKernelImpl::SSE42);
+    }
+    return make_kernels(ScoreKernelImpl::SCALAR);
+}
+
+static ScoreKernels kernels = select_kernels();
+
+void score_fill(int64_t *row, size_t size, int64_t value)
+{
+    kernels.fill(row, size, value);
+}
+
+void score_add(int64_t *row, size_t size, int64_t value)
+{
+    kernels.add(row, size, value);
+}
+
+size_t score_argmax(const int64_t *row, const int *free_cpus, size_t size, int n_cpus)
+{
+    return kernels.argmax(row, free_cpus, size, n_cpus);
+}
+
+ScoreKernelImpl get_score_kernel_impl()
+{
+    return kernels.impl;
+}
+
+bool set_score_kernel_impl(ScoreKernelImpl impl)
+{
+    if (!is_supported(impl)) {
+        return false;
+    }
+    kernels = make_kernels(impl);
+    return true;
+}
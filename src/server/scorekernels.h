@@ -0,0 +1,33 @@
+#ifndef LOOM_SERVER_SCOREKERNELS_H
+#define LOOM_SERVER_SCOREKERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Kernels over rows of the scheduler's score table.
+ *  The implementation is selected at runtime by the features of the CPU */
+
+enum class ScoreKernelImpl {
+    SCALAR,
+    SSE42,
+    AVX2
+};
+
+/** Set all scores of the row to the value */
+void score_fill(int64_t *row, size_t size, int64_t value);
+
+/** Add the value to all scores of the row */
+void score_add(int64_t *row, size_t size, int64_t value);
+
+/** Returns the index of the first maximal score in the row among workers
+ *  with at least n_cpus free cpus; returns size when there is no such worker
+ *  (scores equal to INT64_MIN are never selected) */
+size_t score_argmax(const int64_t *row, const int *free_cpus, size_t size, int n_cpus);
+
+ScoreKernelImpl get_score_kernel_impl();
+
+/** Changes the implementation (for tests and benchmarks);
+ *  returns false if CPU does not support it */
+bool set_score_kernel_impl(ScoreKernelImpl impl);
+
+#endif // LOOM_SERVER_SCOREKERNELS_H
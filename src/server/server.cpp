@@ -18,7 +18,8 @@ Server::Server(uv_loop_t *loop, int port)
       task_manager(*this),
       dummy_worker(*this),
       id_counter(0),
-      task_distribution_active(false)
+      task_distribution_active(false),
+      flush_active(false)
 {
     loom::base::logger->info("Starting loom server; version={}", LOOM_VERSION);
     /* Since the server do not implement fully resource management, we forces
@@ -36,13 +37,28 @@ Server::Server(uv_loop_t *loop, int port)
 
     if (loop) {
         UV_CHECK(uv_idle_init(loop, &distribution_idle));
+        // Prepare handles are run after idle handles and before polling for I/O,
+        // hence commands created by task distribution and by processing of
+        // messages are sent in the same iteration
+        UV_CHECK(uv_prepare_init(loop, &flush_prepare));
     }
 
     distribution_idle.data = this;
+    flush_prepare.data = this;
 }
 
 void Server::add_worker_connection(std::unique_ptr<WorkerConnection> &&conn)
 {
+    // Assign the lowest index that is not used
+    std::vector<bool> used(connections.size(), false);
+    for (auto &wc : connections) {
+        size_t index = wc->get_worker_index();
+        if (index < used.size()) {
+            used[index] = true;
+        }
+    }
+    int index = std::find(used.begin(), used.end(), false) - used.begin();
+    conn->set_worker_index(index);
     connections.push_back(std::move(conn));
 }
 
@@ -117,17 +133,15 @@ void Server::on_task_failed(Id id, WorkerConnection *wc, const std::string &erro
     task_manager.on_task_failed(id, wc, error_msg);
 }
 
-void Server::send_dictionary(loom::base::Socket &socket)
+void Server::send_dictionary(loom::pb::comm::WorkerCommand &msg)
 {
     using namespace loom::pb::comm;
-    WorkerCommand msg;
     msg.set_type(WorkerCommand_Type_DICTIONARY);
     std::vector<std::string> symbols = dictionary.get_all_symbols();
     for (std::string &symbol : symbols) {
         std::string *s = msg.add_symbols();
         *s = symbol;
     }
-    loom::base::send_message(socket, msg);
 }
 
 int Server::get_worker_ncpus()
@@ -155,6 +169,15 @@ void Server::need_task_distribution()
     UV_CHECK(uv_idle_start(&distribution_idle, _distribution_callback));
 }
 
+void Server::need_flush()
+{
+    if (flush_active || loop == NULL) {
+        return;
+    }
+    flush_active = true;
+    UV_CHECK(uv_prepare_start(&flush_prepare, _flush_callback));
+}
+
 void Server::create_trace(const std::string &trace_path)
 {
     // Prepare trace
@@ -216,3 +239,13 @@ void Server::_distribution_callback(uv_idle_t *idle)
     server->task_distribution_active = false;
     server->task_manager.run_task_distribution();
 }
+
+void Server::_flush_callback(uv_prepare_t *prepare)
+{
+    UV_CHECK(uv_prepare_stop(prepare));
+    Server *server = static_cast<Server*>(prepare->data);
+    server->flush_active = false;
+    for (auto &wc : server->connections) {
+        wc->flush_commands();
+    }
+}
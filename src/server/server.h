@@ -71,10 +71,13 @@ public:
         return id;
     }
 
-    void send_dictionary(loom::base::Socket &socket);
+    void send_dictionary(loom::pb::comm::WorkerCommand &msg);
     int get_worker_ncpus();
     void need_task_distribution();
 
+    /** Queued commands of workers will be sent at the end of this loop iteration */
+    void need_flush();
+
     const std::vector<std::unique_ptr<WorkerConnection>>& get_workers() const {
         return connections;
     }
@@ -117,10 +120,14 @@ private:
     bool task_distribution_active;
     uv_idle_t distribution_idle;
 
+    bool flush_active;
+    uv_prepare_t flush_prepare;
+
     std::string trace_dir;
     std::unique_ptr<ServerTrace> trace;
 
     static void _distribution_callback(uv_idle_t *idle);
+    static void _flush_callback(uv_prepare_t *prepare);
 };
 
 #endif // LOOM_SERVER_SERVER_H
@@ -15,9 +15,24 @@
 using namespace loom;
 using namespace loom::base;
 
+// Smaller objects are sent directly from their owners, without relays
+static const size_t BROADCAST_MIN_SIZE = 1 << 20; // 1 MB
+
 TaskManager::TaskManager(Server &server)
-    : server(server), cstate(server)
+    : server(server), cstate(server),
+      scheduler(std::make_unique<LocalityScheduler>(cstate))
+{
+}
+
+bool TaskManager::set_scheduler(const std::string &name, const SchedulerConfig &config)
 {
+    std::unique_ptr<Scheduler> s = Scheduler::create(name, cstate, config);
+    if (!s) {
+        return false;
+    }
+    scheduler = std::move(s);
+    logger->info("Scheduler: {} ({})", name, config.to_string());
+    return true;
 }
 
 loom::base::Id TaskManager::add_plan(const loom::pb::comm::Plan &plan, bool load_checkpoints)
@@ -27,9 +42,11 @@ loom::base::Id TaskManager::add_plan(const loom::pb::comm::Plan &plan, bool load
     for (TaskNode *node : to_load) {
         WorkerConnection *wc = random_worker();
         node->set_as_loading(wc);
-        wc->load_checkpoint(node->get_id(), node->get_task_def().checkpoint_path);
+        wc->load_checkpoint(node->get_id(), node->get_task_def().checkpoint_path.str());
     }
-    distribute_work(schedule(cstate));
+    // New plan may add nexts to already existing nodes
+    scheduler->invalidate_all();
+    distribute_work(scheduler->schedule());
     return id_base;
 }
 
@@ -58,22 +75,73 @@ void TaskManager::start_task(WorkerConnection *wc, TaskNode &node)
 {
     for (TaskNode *input_node : node.get_inputs()) {
         if (input_node->get_worker_status(wc) == TaskStatus::NONE) {
-            WorkerConnection *owner = input_node->get_random_owner();
-            assert(owner);
-            owner->send_data(input_node->get_id(), wc->get_address());
             input_node->set_worker_status(wc, TaskStatus::TRANSFER);
+            // Inputs of tasks on the critical path are sent first
+            transfer_data(*input_node, wc, node.get_rank());
+            scheduler->data_changed(*input_node);
         }
     }
 
     wc->send_task(node);
 
+    node.set_predicted_duration(cstate.estimate_duration(node));
     cstate.activate_pending_node(node, wc);
+    node.set_start_time(uv_now(server.get_loop()));
+    // Rows of tasks that share a next with the node use its predicted size
+    scheduler->data_changed(node);
     //auto &trace = server.get_trace();
     /*if (trace) {
         trace->trace_task_start(node, wc);
     }*/
 }
 
+void TaskManager::transfer_data(TaskNode &node, WorkerConnection *wc, int64_t priority)
+{
+    NodeTransfers &node_transfers = transfers[&node];
+    node_transfers.waiting.push_back(std::make_pair(wc, priority));
+    start_transfers(node, node_transfers);
+}
+
+void TaskManager::start_transfers(TaskNode &node, NodeTransfers &node_transfers)
+{
+    auto &sources = node_transfers.sources;
+    auto &waiting = node_transfers.waiting;
+
+    // Latency of relays is not worth it for small objects
+    bool relays = node.get_size() >= BROADCAST_MIN_SIZE;
+    auto is_busy = [relays, &sources](WorkerConnection *wc) {
+        return relays && std::any_of(sources.begin(), sources.end(),
+            [wc](const std::pair<WorkerConnection*, WorkerConnection*> &p) {
+                return p.second == wc;
+            });
+    };
+
+    while (!waiting.empty()) {
+        auto dest = std::max_element(waiting.begin(), waiting.end(),
+                                     [](const std::pair<WorkerConnection*, int64_t> &a,
+                                        const std::pair<WorkerConnection*, int64_t> &b) {
+                                         return a.second < b.second;
+                                     });
+        WorkerConnection *wc = dest->first;
+        WorkerConnection *source = node.select_owner(wc, is_busy);
+        if (!source) {
+            assert(relays);
+            break;
+        }
+        int64_t priority = dest->second;
+        *dest = waiting.back();
+        waiting.pop_back();
+        sources[wc] = source;
+        source->change_outgoing_bytes(node.get_size());
+        logger->debug("Transfer of id={}: {} -> {} ({} waiting)",
+                      node.get_id(), source->get_address(), wc->get_address(), waiting.size());
+        source->send_data(node.get_id(), wc->get_address(), priority);
+    }
+    if (waiting.empty() && sources.empty()) {
+        transfers.erase(&node);
+    }
+}
+
 void TaskManager::remove_node(TaskNode &node)
 {
     logger->debug("Removing node id={}", node.get_id());
@@ -97,7 +165,15 @@ void TaskManager::on_task_finished(loom::base::Id id, size_t size, size_t length
       return;
    }
    TaskNode &node = cstate.get_node(id);
+   bool ranks_stale = cstate.get_estimator().add_sample(
+      node.get_task_def().task_type, uv_now(server.get_loop()) - node.get_start_time(), size);
    node.set_as_finished(wc, size, length);
+   if (ranks_stale) {
+      // Ranks are part of scores, so all rows are recomputed
+      cstate.update_ranks();
+      scheduler->invalidate_all();
+   }
+   scheduler->data_changed(node);
 
    /*auto &trace = server.get_trace();
     if (trace) {
@@ -122,8 +198,10 @@ void TaskManager::on_task_finished(loom::base::Id id, size_t size, size_t length
         wc->change_checkpoint_writes(1);
    }
 
-   for (TaskNode *input_node : node.get_inputs()) {
-      if (input_node->next_finished(node) && !input_node->is_result()) {
+   const NodeSpan &inputs = node.get_inputs();
+   for (uint32_t i = 0; i < inputs.size(); i++) {
+      TaskNode *input_node = inputs[i];
+      if (input_node->next_finished(node, i) && !input_node->is_result()) {
          remove_node(*input_node);
       }
    }
@@ -152,6 +230,19 @@ void TaskManager::on_data_transferred(Id id, WorkerConnection *wc)
    TaskNode &node = cstate.get_node(id);
    logger->debug("Data id={} transferred to {}", id, wc->get_address());
    node.set_as_transferred(wc);
+   scheduler->data_changed(node);
+
+   auto i = transfers.find(&node);
+   if (i != transfers.end()) {
+      auto &sources = i->second.sources;
+      auto s = sources.find(wc);
+      if (s != sources.end()) {
+         s->second->change_outgoing_bytes(-static_cast<int64_t>(node.get_size()));
+         sources.erase(s);
+      }
+      // Both the source and the new owner may serve waiting workers
+      start_transfers(node, i->second);
+   }
 }
 
 void TaskManager::on_task_failed(Id id, WorkerConnection *wc, const std::string &error_msg)
@@ -207,6 +298,7 @@ void TaskManager::on_checkpoint_load_finished(Id id, WorkerConnection *wc, size_
 
     TaskNode &node = cstate.get_node(id);
     node.set_as_loaded(wc, size, length);
+    scheduler->data_changed(node);
 
     if (node.is_result()) {
        logger->debug("Task id={} [RESULT] checkpoint loaded", id);
@@ -277,7 +369,7 @@ void TaskManager::run_task_distribution()
     }
 
     // Schedule
-    auto distribute = schedule(cstate);
+    auto distribute = scheduler->schedule();
 
     // Update & get time
     uv_update_time(loop);
@@ -303,23 +395,35 @@ void TaskManager::trash_all_tasks()
         wc->change_residual_tasks(wc->get_checkpoint_loads());
         wc->change_checkpoint_loads(-wc->get_checkpoint_loads());
     }
-    cstate.foreach_node([](std::unique_ptr<TaskNode> &task) {
-        task->foreach_worker([&task](WorkerConnection *wc, TaskStatus status) {
+    // Waiting transfers were not sent to workers yet
+    for (auto &pair : transfers) {
+        for (auto &dest : pair.second.waiting) {
+            pair.first->set_worker_status(dest.first, TaskStatus::NONE);
+        }
+        for (auto &source : pair.second.sources) {
+            source.second->change_outgoing_bytes(-static_cast<int64_t>(pair.first->get_size()));
+        }
+    }
+    transfers.clear();
+
+    cstate.foreach_node([](TaskNode &task) {
+        task.foreach_worker([&task](WorkerConnection *wc, TaskStatus status) {
             if (status == TaskStatus::OWNER) {
-              wc->remove_data(task->get_id());
+              wc->remove_data(task.get_id());
             } else if (status == TaskStatus::RUNNING) {
               wc->change_residual_tasks(1);
-              wc->free_resources(*task);
-              logger->debug("Residual task id={} on worker={}", task->get_id(), wc->get_worker_id());
+              wc->free_resources(task);
+              logger->debug("Residual task id={} on worker={}", task.get_id(), wc->get_worker_id());
             } else {
                assert(status == TaskStatus::TRANSFER);
                wc->change_residual_tasks(1);
-               logger->debug("Residual transfer id={} on worker={}", task->get_id(), wc->get_worker_id());
+               logger->debug("Residual transfer id={} on worker={}", task.get_id(), wc->get_worker_id());
             }
             status = TaskStatus::NONE;
         });
     });
     cstate.clear_all();
+    scheduler->clear();
 }
 
 void TaskManager::release_node(TaskNode *node)
@@ -7,6 +7,7 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 class Server;
 class WorkerConnection;
@@ -23,6 +24,9 @@ public:
         cstate.add_node(std::move(node));
     }*/
 
+    /** Replaces the scheduler; returns false when the name is unknown */
+    bool set_scheduler(const std::string &name, const SchedulerConfig &config);
+
     loom::base::Id add_plan(const loom::pb::comm::Plan &plan, bool load_checkpoints);
 
     void on_task_finished(loom::base::Id id, size_t size, size_t length, WorkerConnection *wc, bool checkpointing);
@@ -37,6 +41,10 @@ public:
         return cstate.get_n_data_objects();
     }
 
+    const Estimator& get_estimator() const {
+        return cstate.get_estimator();
+    }
+
     TaskNode* get_node_ptr(loom::base::Id id) {
         return cstate.get_node_ptr(id);
     }
@@ -52,12 +60,27 @@ public:
     WorkerConnection *random_worker();
 
 private:
+    /** Transfers of a data object between workers.
+     *  Each owner sends a big object to one worker at a time and workers that
+     *  receive it become relays, so the number of owners doubles in every
+     *  round (binomial tree). Small objects are sent at once */
+    struct NodeTransfers {
+        // Destinations waiting for a free owner, with priorities of transfers
+        std::vector<std::pair<WorkerConnection*, int64_t>> waiting;
+        // Running transfers; destination -> source
+        std::unordered_map<WorkerConnection*, WorkerConnection*> sources;
+    };
+
     Server &server;
-    ComputationState cstate;    
+    ComputationState cstate;
+    std::unique_ptr<Scheduler> scheduler;
+    std::unordered_map<TaskNode*, NodeTransfers> transfers;
 
     void distribute_work(const TaskDistribution &distribution);
     void start_task(WorkerConnection *wc, TaskNode &node);
     void remove_node(TaskNode &node);
+    void transfer_data(TaskNode &node, WorkerConnection *wc, int64_t priority);
+    void start_transfers(TaskNode &node, NodeTransfers &node_transfers);
 };
 
 
@@ -3,14 +3,23 @@
 #include "workerconn.h"
 #include "libloom/log.h"
 
+#include <algorithm>
 #include <sstream>
 
-TaskNode::TaskNode(loom::base::Id id, TaskDef &&task)
+TaskNode::TaskNode(loom::base::Id id, const TaskDef &task)
     : id(id),
-      task(std::move(task)),
+      task(task),
+      nexts(nullptr),
+      next_edges(nullptr),
+      input_slots(nullptr),
+      n_nexts(0),
+      nexts_capacity(0),
       size(0),
       length(0),
-      remaining_inputs(0)
+      remaining_inputs(0),
+      rank(0),
+      start_time(0),
+      predicted_duration(0)
 {
 
 }
@@ -21,20 +30,93 @@ void TaskNode::reset_result_flag()
    task.flags.reset(static_cast<size_t>(TaskDefFlags::RESULT));
 }
 
+void WorkerStatusSet::set(WorkerConnection *wc, int index, TaskStatus status)
+{
+    Entry *entry = find(index);
+    if (status == TaskStatus::NONE) {
+        if (entry) {
+            *entry = entries[--count];
+        }
+        return;
+    }
+    if (entry) {
+        assert(entry->wc == wc);
+        entry->status = status;
+        return;
+    }
+    if (count == capacity) {
+        capacity *= 2;
+        Entry *new_entries = new Entry[capacity];
+        std::copy(entries, entries + count, new_entries);
+        if (entries != inline_entries) {
+            delete[] entries;
+        }
+        entries = new_entries;
+    }
+    entry = &entries[count++];
+    entry->wc = wc;
+    entry->index = index;
+    entry->status = status;
+}
+
+TaskStatus TaskNode::get_worker_status(const WorkerConnection *wc) const
+{
+    return workers.get(wc->get_worker_index());
+}
+
+void TaskNode::set_worker_status(WorkerConnection *wc, TaskStatus status)
+{
+    workers.set(wc, wc->get_worker_index(), status);
+}
+
 WorkerConnection *TaskNode::get_random_owner()
 {
-    for(auto &pair : workers) {
-        if (pair.second == TaskStatus::OWNER) {
-            return pair.first;
+    for(auto &entry : workers) {
+        if (entry.status == TaskStatus::OWNER) {
+            return entry.wc;
         }
     }
     return nullptr;
 }
 
+static int get_locality(const WorkerConnection *wc, const WorkerConnection *dest)
+{
+    if (!dest) {
+        return 0;
+    }
+    if (wc->get_host() == dest->get_host()) {
+        return 2;
+    }
+    if (!wc->get_rack().empty() && wc->get_rack() == dest->get_rack()) {
+        return 1;
+    }
+    return 0;
+}
+
+WorkerConnection *TaskNode::select_owner(const WorkerConnection *dest,
+                                         const std::function<bool(WorkerConnection*)> &skip) const
+{
+    WorkerConnection *best = nullptr;
+    int best_locality = 0;
+    for (auto &entry : workers) {
+        if (entry.status != TaskStatus::OWNER || (skip && skip(entry.wc))) {
+            continue;
+        }
+        int locality = get_locality(entry.wc, dest);
+        if (!best || locality > best_locality ||
+            (locality == best_locality &&
+             entry.wc->get_outgoing_bytes() < best->get_outgoing_bytes())) {
+            best = entry.wc;
+            best_locality = locality;
+        }
+    }
+    return best;
+}
+
 bool TaskNode::is_active() const
 {
-    for (auto &pair : workers) {
-        if (pair.second == TaskStatus::RUNNING || pair.second == TaskStatus::TRANSFER) {
+    for (auto &entry : workers) {
+        if (entry.status == TaskStatus::RUNNING || entry.status == TaskStatus::TRANSFER) {
             return true;
         }
     }
@@ -43,26 +125,39 @@ bool TaskNode::is_active() const
 
 void TaskNode::reset_owners()
 {
-    for (auto &pair : workers) {
-        if (pair.second == TaskStatus::OWNER) {
-            pair.second = TaskStatus::NONE;
-        }
-    }
+    workers.remove_if([](const WorkerStatusSet::Entry &entry) {
+        return entry.status == TaskStatus::OWNER;
+    });
 }
 
-bool TaskNode::next_finished(TaskNode &node)
+void TaskNode::set_nexts_storage(TaskNode **nodes, uint32_t *edges, uint32_t capacity)
 {
-    auto it = nexts.find(&node);
-    assert(it != nexts.end());
-    nexts.erase(it);
-    return nexts.empty();
+    assert(capacity >= n_nexts);
+    std::copy(nexts, nexts + n_nexts, nodes);
+    std::copy(next_edges, next_edges + n_nexts, edges);
+    nexts = nodes;
+    next_edges = edges;
+    nexts_capacity = capacity;
+}
+
+bool TaskNode::next_finished(TaskNode &node, uint32_t edge)
+{
+    uint32_t slot = node.input_slots[edge];
+    assert(slot < n_nexts && nexts[slot] == &node && next_edges[slot] == edge);
+    uint32_t last = --n_nexts;
+    if (slot != last) {
+        nexts[slot] = nexts[last];
+        next_edges[slot] = next_edges[last];
+        nexts[slot]->input_slots[next_edges[slot]] = slot;
+    }
+    return n_nexts == 0;
 }
 
 void TaskNode::set_as_none(WorkerConnection *wc)
 {
     auto status = get_worker_status(wc);
     if (status == TaskStatus::RUNNING) {
-        wc->add_free_cpus(get_n_cpus());
+        wc->free_resources(*this);
     }
     set_worker_status(wc, TaskStatus::NONE);
 }
@@ -101,8 +196,8 @@ std::string TaskNode::debug_str() const
 {
    std::stringstream s;
    s << "<Node id=" << id;
-   for(auto &pair : workers) {
-      s << ' ' << pair.first->get_address() << ':' << static_cast<int>(pair.second);
+   for(auto &entry : workers) {
+      s << ' ' << entry.wc->get_address() << ':' << static_cast<int>(entry.status);
    }
    s << '>';
    return s.str();
@@ -122,12 +217,12 @@ void TaskNode::set_as_running(WorkerConnection *wc)
 {
     assert(get_worker_status(wc) == TaskStatus::NONE);
     set_worker_status(wc, TaskStatus::RUNNING);
-    wc->remove_free_cpus(get_n_cpus());
+    wc->take_resources(*this);
 }
 
 void TaskNode::set_as_transferred(WorkerConnection *wc)
 {
-    auto &s = workers[wc];
-    assert(s == TaskStatus::TRANSFER);
-    s = TaskStatus::OWNER;
+    WorkerStatusSet::Entry *entry = workers.find(wc->get_worker_index());
+    assert(entry && entry->status == TaskStatus::TRANSFER);
+    entry->status = TaskStatus::OWNER;
 }
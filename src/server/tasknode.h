@@ -4,11 +4,11 @@
 #include "libloom/types.h"
 #include "libloom/compat.h"
 
+#include <functional>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
 #include <assert.h>
+#include <stdint.h>
 #include <bitset>
 
 class WorkerConnection;
@@ -25,14 +25,74 @@ enum class TaskNodeFlags : size_t {
     FLAGS_COUNT
 };
 
+/** Zero terminated string stored in a memory of a plan (see NodeBlock) */
+class StringRef
+{
+public:
+    StringRef() : ptr(""), length(0) {}
+    StringRef(const char *ptr, size_t length) : ptr(ptr), length(length) {}
+
+    const char* c_str() const {
+        return ptr;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    std::string str() const {
+        return std::string(ptr, length);
+    }
+
+private:
+    const char *ptr;
+    uint32_t length;
+};
+
+/** Array of nodes stored in a memory of a plan (see NodeBlock) */
+class NodeSpan
+{
+public:
+    NodeSpan() : first(nullptr), length(0) {}
+    NodeSpan(TaskNode **first, size_t length) : first(first), length(length) {}
+
+    TaskNode* const* begin() const {
+        return first;
+    }
+
+    TaskNode* const* end() const {
+        return first + length;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    TaskNode* operator[](size_t index) const {
+        return first[index];
+    }
+
+private:
+    TaskNode **first;
+    uint32_t length;
+};
+
 struct TaskDef
 {
     int n_cpus; // TODO: Replace by resource index
-    std::vector<TaskNode*> inputs;
+    NodeSpan inputs;
     loom::base::Id task_type;
-    std::string config;
+    StringRef config;
     std::bitset<1> flags;
-    std::string checkpoint_path;
+    StringRef checkpoint_path;
 };
 
 enum class TaskStatus {
@@ -44,14 +104,92 @@ enum class TaskStatus {
 };
 
 
-template<typename T> using WorkerMap = std::unordered_map<WorkerConnection*, T>;
+/** Statuses of a node on workers; entries are keyed by the dense index of
+ *  workers (WorkerConnection::get_worker_index) and only entries with
+ *  a status other than NONE are stored. Nearly all nodes live on one or two
+ *  workers, so the first entries are stored inline and a lookup is a short scan */
+class WorkerStatusSet
+{
+public:
+    struct Entry {
+        WorkerConnection *wc;
+        int index;
+        TaskStatus status;
+    };
+
+    WorkerStatusSet() : entries(inline_entries), count(0), capacity(INLINE_CAPACITY) {}
+    ~WorkerStatusSet() {
+        if (entries != inline_entries) {
+            delete[] entries;
+        }
+    }
+
+    WorkerStatusSet(const WorkerStatusSet&) = delete;
+    WorkerStatusSet& operator=(const WorkerStatusSet&) = delete;
+
+    TaskStatus get(int index) const {
+        const Entry *entry = find(index);
+        return entry ? entry->status : TaskStatus::NONE;
+    }
+
+    /** Setting NONE removes the entry */
+    void set(WorkerConnection *wc, int index, TaskStatus status);
+
+    Entry* find(int index) {
+        for (Entry *entry = entries; entry != entries + count; entry++) {
+            if (entry->index == index) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    const Entry* find(int index) const {
+        return const_cast<WorkerStatusSet*>(this)->find(index);
+    }
+
+    template<typename F> void remove_if(const F &f) {
+        size_t i = 0;
+        while (i < count) {
+            if (f(entries[i])) {
+                entries[i] = entries[--count];
+            } else {
+                i++;
+            }
+        }
+    }
+
+    const Entry* begin() const {
+        return entries;
+    }
+
+    const Entry* end() const {
+        return entries + count;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+private:
+    static const uint32_t INLINE_CAPACITY = 2;
+
+    Entry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    Entry inline_entries[INLINE_CAPACITY];
+};
 
 
 class TaskNode {
 
 public:
 
-    TaskNode(loom::base::Id id, TaskDef &&task);
+    TaskNode(loom::base::Id id, const TaskDef &task);
 
     loom::base::Id get_id() const {
         return id;
@@ -103,33 +241,52 @@ public:
         return task;
     }
 
-    const std::vector<TaskNode*>& get_inputs() const {
+    const NodeSpan& get_inputs() const {
         return task.inputs;
     }
 
-    const std::unordered_multiset<TaskNode*>& get_nexts() const {
-        return nexts;
+    /** Nexts that are not finished yet (a node occurs more times when
+     *  it uses this node as input on more positions) */
+    NodeSpan get_nexts() const {
+        return NodeSpan(nexts, n_nexts);
     }
 
-    bool is_active() const;
-    WorkerConnection* get_random_owner();
-
-    void add_next(TaskNode *node) {
-        nexts.insert(node);
+    /** Number of nexts that fit into the storage of nexts */
+    uint32_t get_nexts_capacity() const {
+        return nexts_capacity;
     }
 
-    TaskStatus get_worker_status(WorkerConnection *wc) {
-        auto i = workers.find(wc);
-        if (i == workers.end()) {
-            return TaskStatus::NONE;
-        }
-        return i->second;
+    /** Moves nexts into a new storage (see NodeBlock);
+     *  edges has to have the same capacity as nodes */
+    void set_nexts_storage(TaskNode **nodes, uint32_t *edges, uint32_t capacity);
+
+    /** Array parallel to inputs; a position of this node in nexts of the input */
+    void set_input_slots(uint32_t *slots) {
+        input_slots = slots;
     }
 
-    void set_worker_status(WorkerConnection *wc, TaskStatus status) {
-        workers[wc] = status;
+    bool is_active() const;
+    WorkerConnection* get_random_owner();
+
+    /** Owner that should send the data to dest (nullptr when dest is not a
+     *  worker); owners on the same host, then in the same rack, are preferred
+     *  and then owners with the least outgoing bytes. Owners for which
+     *  skip returns true are ignored. Returns nullptr if there is no owner */
+    WorkerConnection* select_owner(const WorkerConnection *dest,
+                                   const std::function<bool(WorkerConnection*)> &skip = nullptr) const;
+
+    /** Node uses this node as its input on position edge */
+    void add_next(TaskNode *node, uint32_t edge) {
+        assert(n_nexts < nexts_capacity);
+        node->input_slots[edge] = n_nexts;
+        nexts[n_nexts] = node;
+        next_edges[n_nexts] = edge;
+        n_nexts++;
     }
 
+    TaskStatus get_worker_status(const WorkerConnection *wc) const;
+    void set_worker_status(WorkerConnection *wc, TaskStatus status);
+
     void set_remaining_inputs(int value) {
         remaining_inputs = value;
     }
@@ -147,29 +304,57 @@ public:
        return remaining_inputs == 0;
     }
 
+    /** Bottom level of the node; an estimated length of the longest path
+     *  from this node to the end of the plan (including the node itself) */
+    int64_t get_rank() const {
+        return rank;
+    }
+
+    void set_rank(int64_t value) {
+        rank = value;
+    }
+
+    /** Time (uv_now) when the task was sent to a worker */
+    uint64_t get_start_time() const {
+        return start_time;
+    }
+
+    void set_start_time(uint64_t value) {
+        start_time = value;
+    }
+
+    /** Duration (ms) predicted when the task was sent to a worker */
+    int64_t get_predicted_duration() const {
+        return predicted_duration;
+    }
+
+    void set_predicted_duration(int64_t value) {
+        predicted_duration = value;
+    }
+
     template<typename F> inline void foreach_owner(const F &f) const {
-        for(auto &pair : workers) {
-            if (pair.second == TaskStatus::OWNER) {
-                f(pair.first);
+        for(auto &entry : workers) {
+            if (entry.status == TaskStatus::OWNER) {
+                f(entry.wc);
             }
         }
     }
 
     template<typename F> inline void foreach_worker(const F &f) const {
-        for(auto &pair : workers) {
-            if (pair.second != TaskStatus::NONE) {
-                f(pair.first, pair.second);
-            }
+        for(auto &entry : workers) {
+            f(entry.wc, entry.status);
         }
     }
 
     void reset_owners();
 
-    const WorkerMap<TaskStatus>& get_workers() const {
+    const WorkerStatusSet& get_workers() const {
         return workers;
     }
 
-    bool next_finished(TaskNode &);
+    /** Removes a finished next that uses this node on position edge;
+     *  returns true if there are no unfinished nexts */
+    bool next_finished(TaskNode &node, uint32_t edge);
 
     void set_as_finished(WorkerConnection *wc, size_t size, size_t length);
     void set_as_loaded(WorkerConnection *wc, size_t size, size_t length);
@@ -192,14 +377,24 @@ private:
     // Declaration
     loom::base::Id id;
     TaskDef task;
-    std::unordered_multiset<TaskNode*> nexts;
+
+    // Unfinished nexts are the first n_nexts entries; entries are removed
+    // by swapping with the last one, edges and slots keep both sides in sync
+    TaskNode **nexts;
+    uint32_t *next_edges; // Position of this node in inputs of the next
+    uint32_t *input_slots;
+    uint32_t n_nexts;
+    uint32_t nexts_capacity;
 
     // Runtime info
     std::bitset<3> flags;
-    WorkerMap<TaskStatus> workers;
+    WorkerStatusSet workers;
     size_t size;
     size_t length;
     size_t remaining_inputs;
+    int64_t rank;
+    uint64_t start_time;
+    int64_t predicted_duration;
     bool _slow_is_ready() const;
 };
 
@@ -9,6 +9,9 @@
 using namespace loom;
 using namespace loom::base;
 
+static const size_t HIGH_WATERMARK = 4 << 20; // 4 MB
+static const size_t LOW_WATERMARK = 1 << 20; // 1 MB
+
 WorkerConnection::WorkerConnection(Server &server,
                                    std::unique_ptr<loom::base::Socket> socket,
                                    const std::string& address,
@@ -19,24 +22,34 @@ WorkerConnection::WorkerConnection(Server &server,
       socket(std::move(socket)),
       free_cpus(resource_cpus),
       resource_cpus(resource_cpus),
+      running_work(0),
       address(address),
+      host(address.substr(0, address.rfind(':'))),
+      outgoing_bytes(0),
       task_types(task_types),
       data_types(data_types),
       worker_id(worker_id),
+      worker_index(-1),
       n_residual_tasks(0),
       checkpoint_writes(0),
-      checkpoint_loads(0)
+      checkpoint_loads(0),
+      commands(std::make_unique<loom::pb::comm::WorkerCommandBatch>())
 {
     logger->info("Worker {} connected (cpus={})", address, resource_cpus);
     if (this->socket) {
         this->socket->set_on_message([this](const char *buffer, size_t size) {
             on_message(buffer, size);
         });
+        this->socket->set_watermarks(HIGH_WATERMARK, LOW_WATERMARK);
+        this->socket->set_on_drain([this]() {
+            logger->debug("Worker {} is not congested", this->address);
+            this->server.need_task_distribution();
+        });
         this->socket->set_on_close([this](){
             logger->info("Worker {} disconnected.", this->address);
             this->server.remove_worker_connection(*this);
         });
-        server.send_dictionary(*this->socket);
+        server.send_dictionary(*add_command());
     }
 
     if (task_types.size() == 0) {
@@ -44,12 +57,27 @@ WorkerConnection::WorkerConnection(Server &server,
     }
 }
 
+WorkerConnection::~WorkerConnection()
+{
+
+}
+
 void WorkerConnection::on_message(const char *buffer, size_t size)
 {
     using namespace loom::pb::comm;
-    WorkerResponse msg;
-    msg.ParseFromArray(buffer, size);
+    WorkerResponseBatch batch;
+    batch.ParseFromArray(buffer, size);
+
+    // Task distribution is deferred to an idle handle, so the whole batch
+    // is processed before the next distribution round
+    for (const WorkerResponse &msg : batch.responses()) {
+        on_response(msg);
+    }
+}
 
+void WorkerConnection::on_response(const loom::pb::comm::WorkerResponse &msg)
+{
+    using namespace loom::pb::comm;
     auto type = msg.type();
     if (type == WorkerResponse_Type_FINISHED) {
         server.on_task_finished(msg.id(), msg.size(), msg.length(), this, false);
@@ -100,31 +128,31 @@ void WorkerConnection::send_task(const TaskNode &task)
     logger->debug("Assigning task id={} to address={} cpus={}",
                   id, address, task.get_n_cpus());
 
-    WorkerCommand msg;
+    WorkerCommand &msg = *add_command();
     msg.set_type(WorkerCommand_Type_TASK);
     msg.set_id(id);
     const TaskDef& def = task.get_task_def();
     msg.set_task_type(def.task_type);
-    msg.set_task_config(def.config);
+    msg.set_task_config(def.config.c_str(), def.config.size());
     msg.set_n_cpus(def.n_cpus);
-    msg.set_checkpoint_path(def.checkpoint_path);
+    msg.set_checkpoint_path(def.checkpoint_path.c_str(), def.checkpoint_path.size());
 
     for (TaskNode *input_node : task.get_inputs()) {
         msg.add_task_inputs(input_node->get_id());
     }
-    send_message(*socket, msg);
 }
 
-void WorkerConnection::send_data(Id id, const std::string &address)
+void WorkerConnection::send_data(Id id, const std::string &address, int64_t priority)
 {
     using namespace loom::pb::comm;
-    logger->debug("Command for {}: SEND id={} address={}", this->address, id, address);
+    logger->debug("Command for {}: SEND id={} address={} priority={}",
+                  this->address, id, address, priority);
 
-    WorkerCommand msg;
+    WorkerCommand &msg = *add_command();
     msg.set_type(WorkerCommand_Type_SEND);
     msg.set_id(id);
     msg.set_address(address);
-    send_message(*socket, msg);
+    msg.set_priority(priority);
 }
 
 void WorkerConnection::load_checkpoint(Id id, const std::string &checkpoint_path)
@@ -133,26 +161,31 @@ void WorkerConnection::load_checkpoint(Id id, const std::string &checkpoint_path
     using namespace loom::pb::comm;
     logger->debug("Command for {}: LOAD_CHECKPOINT id={} path={}", this->address, id, checkpoint_path);
 
-    WorkerCommand msg;
+    WorkerCommand &msg = *add_command();
     msg.set_type(WorkerCommand_Type_LOAD_CHECKPOINT);
     msg.set_id(id);
     msg.set_checkpoint_path(checkpoint_path);
-    send_message(*socket, msg);
 }
 
 void WorkerConnection::remove_data(Id id)
 {
     using namespace loom::pb::comm;
     logger->debug("Command for {}: REMOVE id={}", this->address, id);
-    WorkerCommand msg;
+    WorkerCommand &msg = *add_command();
     msg.set_type(WorkerCommand_Type_REMOVE);
     msg.set_id(id);
-    send_message(*socket, msg);
+}
+
+void WorkerConnection::take_resources(TaskNode &node)
+{
+   remove_free_cpus(node.get_n_cpus());
+   running_work += node.get_predicted_duration() * node.get_n_cpus();
 }
 
 void WorkerConnection::free_resources(TaskNode &node)
 {
    add_free_cpus(node.get_n_cpus());
+   running_work -= node.get_predicted_duration() * node.get_n_cpus();
 }
 
 void WorkerConnection::residual_task_finished(Id id, bool success, bool checkpointing)
@@ -184,9 +217,33 @@ void WorkerConnection::residual_checkpoint_finished(Id id)
 void WorkerConnection::create_trace(const std::string &trace_path)
 {
     using namespace loom::pb::comm;
-    WorkerCommand msg;
+    WorkerCommand &msg = *add_command();
     msg.set_type(WorkerCommand_Type_UPDATE);
     msg.set_trace_path(trace_path);
     msg.set_worker_id(worker_id);
-    send_message(*socket, msg);
+}
+
+loom::pb::comm::WorkerCommand* WorkerConnection::add_command()
+{
+    if (commands->commands_size() == 0) {
+        server.need_flush();
+    }
+    return commands->add_commands();
+}
+
+void WorkerConnection::flush_commands()
+{
+    if (commands->commands_size() == 0) {
+        return;
+    }
+    logger->debug("Sending {} command(s) to {}", commands->commands_size(), address);
+    if (socket) {
+        send_message(*socket, *commands);
+    }
+    commands->Clear();
+}
+
+size_t WorkerConnection::get_n_queued_commands() const
+{
+    return commands->commands_size();
 }
@@ -10,6 +10,16 @@
 class Server;
 class TaskNode;
 
+namespace loom {
+namespace pb {
+namespace comm {
+
+class WorkerCommand;
+class WorkerCommandBatch;
+class WorkerResponse;
+
+}}}
+
 
 /** Connection to worker */
 class WorkerConnection {
@@ -22,16 +32,42 @@ public:
                      const std::vector<loom::base::Id> &data_types,
                      int resource_cpus,
                      int worker_id);
+    ~WorkerConnection();
+
     void on_message(const char *buffer, size_t size);
 
     void send_task(const TaskNode &task);
-    void send_data(loom::base::Id id, const std::string &address);
+    /** Transfers with higher priority are started first by the worker */
+    void send_data(loom::base::Id id, const std::string &address, int64_t priority = 0);
     void remove_data(loom::base::Id id);
 
     const std::string &get_address() {
         return address;
     }
 
+    /** Host part of the address */
+    const std::string &get_host() const {
+        return host;
+    }
+
+    /** Label set by the worker option --rack, empty when it is not set */
+    const std::string &get_rack() const {
+        return rack;
+    }
+
+    void set_rack(const std::string &value) {
+        rack = value;
+    }
+
+    /** Bytes of data objects that the worker is sending to other workers */
+    size_t get_outgoing_bytes() const {
+        return outgoing_bytes;
+    }
+
+    void change_outgoing_bytes(int64_t value) {
+        outgoing_bytes += value;
+    }
+
     int get_resource_cpus() const {
         return resource_cpus;
     }
@@ -40,6 +76,17 @@ public:
         return worker_id;
     }
 
+    /** Dense index of the worker; it is assigned by the server when the
+     *  connection is registered and it is not changed while the worker lives.
+     *  Indices of removed workers are reused */
+    int get_worker_index() const {
+        return worker_index;
+    }
+
+    void set_worker_index(int value) {
+        worker_index = value;
+    }
+
     int get_free_cpus() const {
         return free_cpus;
     }
@@ -73,6 +120,12 @@ public:
        return n_residual_tasks > 0 && checkpoint_writes > 0;
     }
 
+    /** Too many commands wait to be written to the worker;
+     *  no new tasks are scheduled to it */
+    bool is_congested() const {
+       return socket && socket->is_congested();
+    }
+
     void change_residual_tasks(int value) {
        n_residual_tasks += value;
     }
@@ -89,25 +142,48 @@ public:
         checkpoint_loads += value;
     }
 
+    /** Cpus and predicted work of a task started on the worker */
+    void take_resources(TaskNode &node);
     void free_resources(TaskNode &node);
 
+    /** Predicted work (cpus * ms) of tasks running on the worker */
+    int64_t get_running_work() const {
+        return running_work;
+    }
+
     void residual_task_finished(loom::base::Id id, bool success, bool checkpointing);
     void residual_checkpoint_finished(loom::base::Id id);
 
     void create_trace(const std::string &trace_path);
     void load_checkpoint(loom::base::Id id, const std::string &checkpoint_path);
 
+    /** Sends all commands created since the last flush as one message */
+    void flush_commands();
+
+    size_t get_n_queued_commands() const;
+
 private:
+    /** Commands are not sent immediately, they are collected and sent
+     *  by the server at the end of the loop iteration (see Server::need_flush) */
+    loom::pb::comm::WorkerCommand* add_command();
+
+    void on_response(const loom::pb::comm::WorkerResponse &msg);
+
     Server &server;
     std::unique_ptr<loom::base::Socket> socket;
     int free_cpus;
     int resource_cpus;
+    int64_t running_work;
     std::string address;
+    std::string host;
+    std::string rack;
+    size_t outgoing_bytes;
 
     std::vector<int> task_types;
     std::vector<int> data_types;
 
     int worker_id;
+    int worker_index;
     int n_residual_tasks;
     int n_residual_checkpoints;
     int checkpoint_writes;
@@ -115,6 +191,8 @@ private:
 
     int scheduler_index;
     int scheduler_free_cpus;
+
+    std::unique_ptr<loom::pb::comm::WorkerCommandBatch> commands;
 };
 
 #endif // LOOM_SERVER_WORKERCONN
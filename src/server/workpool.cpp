@@ -0,0 +1,96 @@
+#include "workpool.h"
+
+#include <assert.h>
+
+WorkPool::WorkPool(size_t n_threads)
+    : job(nullptr), size(0), chunk_size(1), next_chunk(0),
+      generation(0), n_finished(0), stop(false)
+{
+    for (size_t i = 1; i < n_threads; i++) {
+        threads.emplace_back(&WorkPool::thread_main, this);
+    }
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start_cv.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkPool::run_chunks()
+{
+    for (;;) {
+        size_t begin = next_chunk.fetch_add(1) * chunk_size;
+        if (begin >= size) {
+            return;
+        }
+        size_t end = begin + chunk_size;
+        if (end > size) {
+            end = size;
+        }
+        (*job)(begin, end);
+    }
+}
+
+void WorkPool::thread_main()
+{
+    unsigned seen_generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [this, seen_generation]() {
+                return stop || generation != seen_generation;
+            });
+            if (stop) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_chunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            n_finished++;
+        }
+        done_cv.notify_one();
+    }
+}
+
+void WorkPool::parallel_for(size_t size, size_t chunk_size, const Job &job)
+{
+    assert(chunk_size > 0);
+    if (threads.empty() || size <= chunk_size) {
+        if (size > 0) {
+            job(0, size);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->size = size;
+        this->chunk_size = chunk_size;
+        next_chunk = 0;
+        n_finished = 0;
+        generation++;
+    }
+    start_cv.notify_all();
+
+    run_chunks();
+
+    // Every thread has to finish this loop, otherwise it could
+    // take chunks of the next loop with the old job
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this]() {
+        return n_finished == threads.size();
+    });
+    this->job = nullptr;
+}
@@ -0,0 +1,53 @@
+#ifndef LOOM_SERVER_WORKPOOL_H
+#define LOOM_SERVER_WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Small pool of threads for data parallel loops.
+ *  The thread that calls parallel_for also takes part in the work */
+class WorkPool {
+
+public:
+    using Job = std::function<void(size_t begin, size_t end)>;
+
+    /** Creates pool with n_threads threads (including the calling thread) */
+    explicit WorkPool(size_t n_threads);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    /** Calls job on disjoint chunks that cover [0, size);
+     *  returns when all chunks are finished */
+    void parallel_for(size_t size, size_t chunk_size, const Job &job);
+
+    size_t get_n_threads() const {
+        return threads.size() + 1;
+    }
+
+private:
+    void thread_main();
+    void run_chunks();
+
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+
+    // Current loop; it is changed only when all threads finished the previous one
+    const Job *job;
+    size_t size;
+    size_t chunk_size;
+    std::atomic<size_t> next_chunk;
+    unsigned generation;
+    size_t n_finished;
+    bool stop;
+};
+
+#endif // LOOM_SERVER_WORKPOOL_H
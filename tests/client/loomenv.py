@@ -71,7 +71,7 @@ class LoomEnv(Env):
     PORT = 19010
     _client = None
 
-    def start(self, workers_count, cpus=1):
+    def start(self, workers_count, cpus=1, worker_options=()):
         self.workers_count = workers_count
         if self.processes:
             self._client = None
@@ -91,8 +91,8 @@ class LoomEnv(Env):
                        "--debug",
                        "--nopin",
                        "--wdir=" + LOOM_TEST_BUILD_DIR,
-                       "--cpus=" + str(cpus),
-                       "127.0.0.1", str(self.PORT))
+                       "--cpus=" + str(cpus)) + tuple(worker_options) + \
+                      ("127.0.0.1", str(self.PORT))
         if VALGRIND:
             time.sleep(2)
             worker_args = valgrind_args + worker_args
@@ -150,9 +150,24 @@ class LoomEnv(Env):
     def client(self):
         if self._client is None:
             self._client = client.Client("localhost", self.PORT)
+            if self.wait_for_workers():
+                # Dictionary of the client misses symbols of late workers
+                self._client.close()
+                self._client = client.Client("localhost", self.PORT)
             self.check_stats()
         return self._client
 
+    def wait_for_workers(self, timeout=5):
+        # Workers start slowly on a loaded machine;
+        # returns True when some of them were not registered yet
+        end = time.time() + timeout
+        waited = False
+        while (self._client.get_stats()["n_workers"] < self.workers_count and
+               time.time() < end):
+            waited = True
+            time.sleep(0.05)
+        return waited
+
     def submit_and_gather(self, tasks, check=True, load=False):
         if isinstance(tasks, Task):
             future = self.client.submit_one(tasks, load=load)
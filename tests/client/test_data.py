@@ -66,6 +66,63 @@ def test_open_and_merge(loom_env):
     assert result == expect
 
 
+def test_open_fetch(loom_env):
+    a = tasks.open(FILE1)
+    b = tasks.open(FILE2)
+    c = tasks.merge((a, b))
+    loom_env.start(2)
+    result_a, result_b, result_c = loom_env.submit_and_gather((a, b, c))
+    with open(FILE1, "rb") as f:
+        assert result_a == f.read()
+    with open(FILE2, "rb") as f:
+        assert result_b == f.read()
+    assert result_c == result_a + result_b
+
+
+def test_merge_big_w2(loom_env):
+    # Outputs larger than 64kB are file-backed and workers
+    # on the same host exchange them through files
+    loom_env.start(2)
+    parts = [tasks.run(["/bin/sh", "-c", "sleep 0.2; head -c 200000 /dev/zero"])
+             for i in range(4)]
+    c = tasks.merge(parts)
+    result = loom_env.submit_and_gather(c)
+    assert result == b"\0" * 800000
+
+
+def test_merge_big_compressed(loom_env):
+    loom_env.start(2, worker_options=("--compress", "--nolocal"))
+    # Outputs of "yes" are compressible, random data are not
+    commands = ["sleep 0.2; yes loom | head -c 300000",
+                "sleep 0.2; head -c 300000 /dev/urandom"] * 2
+    parts = [tasks.run(["/bin/sh", "-c", c]) for c in commands]
+    c = tasks.merge(parts)
+    result = loom_env.submit_and_gather([c] + parts)
+    assert result[0] == b"".join(result[1:])
+    assert result[1] == b"loom\n" * 60000
+    assert result[3] == b"loom\n" * 60000
+
+
+def test_merge_transfer_limits(loom_env):
+    # Only one transfer at once; the others wait in the queue of the worker
+    loom_env.start(3, worker_options=("--transfers=1", "--peer-transfers=1"))
+    parts = [tasks.run(["/bin/sh", "-c", "head -c 100000 /dev/zero"])
+             for i in range(12)]
+    merges = [tasks.merge(parts[i:]) for i in range(0, 12, 3)]
+    results = loom_env.submit_and_gather(merges)
+    assert results == [b"\0" * (12 - i) * 100000 for i in range(0, 12, 3)]
+
+
+def test_broadcast_big(loom_env):
+    # Workers that received the object relay it to the others
+    loom_env.start(4, worker_options=("--nolocal",))
+    big = tasks.run(["/bin/sh", "-c", "head -c 3000000 /dev/zero"])
+    consumers = [tasks.run(["/bin/sh", "-c", "sleep 0.2; wc -c"], stdin=big)
+                 for i in range(8)]
+    results = loom_env.submit_and_gather(consumers)
+    assert results == [b"3000000\n"] * 8
+
+
 def test_open_and_splitlines(loom_env):
     loom_env.start(1)
     a = tasks.open(FILE2)
@@ -0,0 +1,119 @@
+#include "catch/catch.hpp"
+
+#include "src/server/scorekernels.h"
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+static const ScoreKernelImpl IMPLS[] = {
+    ScoreKernelImpl::SCALAR,
+    ScoreKernelImpl::SSE42,
+    ScoreKernelImpl::AVX2
+};
+
+static const char *impl_name(ScoreKernelImpl impl)
+{
+    switch (impl) {
+    case ScoreKernelImpl::SSE42:
+        return "sse4.2";
+    case ScoreKernelImpl::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+static size_t argmax_reference(const std::vector<int64_t> &row, const std::vector<int> &free_cpus, int n_cpus)
+{
+    size_t index = row.size();
+    int64_t score = INT64_MIN;
+    for (size_t i = 0; i < row.size(); i++) {
+        if (row[i] > score && n_cpus <= free_cpus[i]) {
+            score = row[i];
+            index = i;
+        }
+    }
+    return index;
+}
+
+TEST_CASE("score-kernels", "[scheduling]") {
+    ScoreKernelImpl original = get_score_kernel_impl();
+    std::mt19937 rng(42);
+
+    for (ScoreKernelImpl impl : IMPLS) {
+        if (!set_score_kernel_impl(impl)) {
+            continue;
+        }
+        INFO("impl=" << impl_name(impl));
+
+        for (size_t size = 0; size < 40; size++) {
+            std::vector<int64_t> row(size);
+            std::vector<int> free_cpus(size);
+
+            score_fill(&row[0], size, 7);
+            for (int64_t v : row) {
+                REQUIRE(v == 7);
+            }
+            score_add(&row[0], size, -10);
+            for (int64_t v : row) {
+                REQUIRE(v == -3);
+            }
+
+            for (int round = 0; round < 50; round++) {
+                // Few distinct values to get ties
+                std::uniform_int_distribution<int64_t> score_dist(-3, 3);
+                std::uniform_int_distribution<int> cpu_dist(0, 3);
+                for (size_t i = 0; i < size; i++) {
+                    row[i] = score_dist(rng);
+                    if (row[i] == -3) {
+                        row[i] = INT64_MIN;
+                    }
+                    free_cpus[i] = cpu_dist(rng);
+                }
+                int n_cpus = cpu_dist(rng);
+                REQUIRE(score_argmax(&row[0], &free_cpus[0], size, n_cpus) ==
+                        argmax_reference(row, free_cpus, n_cpus));
+            }
+        }
+    }
+    set_score_kernel_impl(original);
+}
+
+TEST_CASE("benchmark-score-kernels", "[benchmark][!hide]") {
+    using namespace std::chrono;
+    const size_t ROWS = 10000;
+    ScoreKernelImpl original = get_score_kernel_impl();
+
+    for (size_t n_workers = 16; n_workers <= 1024; n_workers *= 4) {
+        std::vector<int64_t> table(ROWS * n_workers);
+        std::vector<int> free_cpus(n_workers);
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> cpu_dist(0, 24);
+        for (size_t i = 0; i < n_workers; i++) {
+            free_cpus[i] = cpu_dist(rng);
+        }
+
+        for (ScoreKernelImpl impl : IMPLS) {
+            if (!set_score_kernel_impl(impl)) {
+                continue;
+            }
+            auto start = steady_clock::now();
+            size_t check = 0;
+            for (size_t r = 0; r < ROWS; r++) {
+                int64_t *row = &table[r * n_workers];
+                score_fill(row, n_workers, 0);
+                score_add(row, n_workers, r);
+                row[r % n_workers] += 1;
+                check += score_argmax(row, &free_cpus[0], n_workers, 1);
+            }
+            auto end = steady_clock::now();
+            auto ds = duration_cast<duration<double>>(end - start);
+            std::cout << "!! " << impl_name(impl) << " workers=" << n_workers
+                      << " rows=" << ROWS << " time=" << ds.count()
+                      << " (" << check << ")" << std::endl;
+        }
+    }
+    set_score_kernel_impl(original);
+}
@@ -2,6 +2,9 @@
 
 #include "libloomw/resourcem.h"
 
+#include <sys/syscall.h>
+#include <unistd.h>
+
 using namespace loom;
 
 template<typename T>
@@ -98,13 +101,166 @@ TEST_CASE("resourcem-alloc-2cpu", "[resourcem]") {
 }
 
 
-TEST_CASE("taskset", "[resourcem]") {
-    std::vector<int> cpus3 = {1, 3, 5};
-    std::vector<std::string> expected3 = { "taskset", "-c", "1,3,5" };
-    std::vector<int> cpus1 = {123};
-    std::vector<std::string> expected1 = { "taskset", "-c", "123" };
+/* Two nodes (packages) with two cores, each core has two SMT siblings:
+   node 0: cores {0, 4} {1, 5}; node 1: cores {2, 6} {3, 7} */
+static CpuTopology make_topology()
+{
+    CpuTopology topology;
+    for (int id = 0; id < 8; id++) {
+        int package = (id % 4) / 2;
+        topology.add_cpu(id, package, id % 2, package);
+    }
+    return topology;
+}
+
+TEST_CASE("resourcem-topology", "[resourcem]") {
+    CpuTopology topology = make_topology();
+    REQUIRE(topology.get_n_nodes() == 2);
+    REQUIRE(topology.get_n_core_groups() == 4);
+    REQUIRE(topology.get_cpus()[0].core_group == topology.get_cpus()[4].core_group);
+    REQUIRE(topology.get_cpus()[0].core_group != topology.get_cpus()[2].core_group);
+
+    SECTION("Select cores of one node first") {
+        CpuTopology selected = topology.select(3);
+        auto &cpus = selected.get_cpus();
+        REQUIRE(cpus.size() == 3);
+        REQUIRE(cpus[0].id == 0);
+        REQUIRE(cpus[1].id == 1);
+        REQUIRE(cpus[2].id == 4);
+    }
+
+    SECTION("Compact sets") {
+        loom::ResourceManager rm;
+        rm.init(0, topology, false);
+        REQUIRE(rm.get_total_cpus() == 8);
+
+        ResourceAllocation ra = rm.allocate(2);
+        REQUIRE(check_uvector(ra.get_cpus(), {0, 4}));
+        REQUIRE(ra.get_numa_node() == 0);
+
+        // The only node that fits it
+        ResourceAllocation rb = rm.allocate(4);
+        REQUIRE(check_uvector(rb.get_cpus(), {2, 3, 6, 7}));
+        REQUIRE(rb.get_numa_node() == 1);
+
+        ResourceAllocation rc = rm.allocate(1);
+        REQUIRE(check_uvector(rc.get_cpus(), {1}));
+        REQUIRE(rc.get_numa_node() == 0);
+
+        rm.free(rb);
+        rm.free(rc);
+
+        // Node with the least free cpus is used
+        ResourceAllocation rd = rm.allocate(2);
+        REQUIRE(check_uvector(rd.get_cpus(), {1, 5}));
+
+        ResourceAllocation re = rm.allocate(4);
+        REQUIRE(check_uvector(re.get_cpus(), {2, 3, 6, 7}));
+        rm.free(ra);
+        rm.free(rd);
+        rm.free(re);
+
+        ra = rm.allocate(2);
+        rb = rm.allocate(4);
+        REQUIRE(rb.get_numa_node() == 1);
+        rc = rm.allocate(2);
+        rm.free(ra);
+        rm.free(rb);
+
+        // Spans nodes
+        ResourceAllocation rf = rm.allocate(5);
+        REQUIRE(rf.get_numa_node() == -1);
+        REQUIRE(rf.get_cpus().size() == 5);
+        std::set<int> s(rf.get_cpus().begin(), rf.get_cpus().end());
+        REQUIRE(s.size() == 5);
+        REQUIRE(s.count(1) == 0);
+        REQUIRE(s.count(5) == 0);
+        REQUIRE(!rm.allocate(2).is_valid());
+    }
+
+    SECTION("Avoid SMT siblings") {
+        loom::ResourceManager rm;
+        rm.init(0, topology, true);
+
+        ResourceAllocation ra = rm.allocate(2);
+        REQUIRE(check_uvector(ra.get_cpus(), {0, 1}));
+
+        // Node is chosen before cores
+        ResourceAllocation rb = rm.allocate(1);
+        REQUIRE(check_uvector(rb.get_cpus(), {4}));
+
+        ResourceAllocation rc = rm.allocate(2);
+        REQUIRE(check_uvector(rc.get_cpus(), {2, 3}));
+    }
+
+    SECTION("Part of the topology") {
+        loom::ResourceManager rm;
+        rm.init(2, topology, false);
+        REQUIRE(rm.get_total_cpus() == 2);
+        ResourceAllocation ra = rm.allocate(2);
+        REQUIRE(check_uvector(ra.get_cpus(), {0, 1}));
+        // Only one node is used
+        REQUIRE(ra.get_numa_node() == -1);
+    }
+}
+
+TEST_CASE("resourcem-read-topology", "[resourcem]") {
+    CpuTopology topology = CpuTopology::read();
+    auto &cpus = topology.get_cpus();
+    REQUIRE(!cpus.empty());
+    REQUIRE(topology.get_n_nodes() >= 1);
+
+    cpu_set_t set;
+    REQUIRE(sched_getaffinity(0, sizeof(set), &set) == 0);
+    REQUIRE(cpus.size() == static_cast<size_t>(CPU_COUNT(&set)));
+}
+
+TEST_CASE("thread-binding", "[resourcem]") {
+    cpu_set_t before;
+    REQUIRE(sched_getaffinity(0, sizeof(before), &before) == 0);
+    int cpu = CpuTopology::read().get_cpus()[0].id;
+
+    {
+        ThreadBinding binding({cpu}, -1);
+        REQUIRE(binding.is_pinned());
+        cpu_set_t set;
+        REQUIRE(sched_getaffinity(0, sizeof(set), &set) == 0);
+        REQUIRE(CPU_COUNT(&set) == 1);
+        REQUIRE(CPU_ISSET(cpu, &set));
+    }
+
+    cpu_set_t after;
+    REQUIRE(sched_getaffinity(0, sizeof(after), &after) == 0);
+    REQUIRE(CPU_EQUAL(&before, &after));
+
+    ThreadBinding none({}, -1);
+    REQUIRE(!none.is_pinned());
+}
+
+TEST_CASE("thread-binding-memory", "[resourcem]") {
+    const int MPOL_DEFAULT = 0;
+    const int MPOL_PREFERRED = 1;
+    const unsigned long MAXNODE = 1024;
+    unsigned long mask[MAXNODE / (8 * sizeof(unsigned long))] = {};
+
+    // Policy of the worker set from outside, e.g. by numactl --preferred=0
+    mask[0] = 1;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAXNODE + 1)) {
+        WARN("Memory policies are not available");
+        return;
+    }
+    int cpu = CpuTopology::read().get_cpus()[0].id;
+
+    {
+        ThreadBinding binding({cpu}, 0);
+        REQUIRE(binding.is_memory_bound());
+    }
+
+    int mode = -1;
+    mask[0] = 0;
+    REQUIRE(syscall(SYS_get_mempolicy, &mode, mask, MAXNODE, nullptr, 0) == 0);
+    REQUIRE(mode == MPOL_PREFERRED);
+    REQUIRE(mask[0] == 1);
 
-    REQUIRE(expected1 == loom::taskset_command(cpus1));
-    REQUIRE(expected3 == loom::taskset_command(cpus3));
-    REQUIRE(loom::taskset_command({}).empty());
+    REQUIRE(syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0) == 0);
 }
@@ -1,12 +1,15 @@
 #include "catch/catch.hpp"
 
 #include "src/server/server.h"
+#include "src/server/workpool.h"
 
 #include "libloom/compat.h"
 #include "pb/comm.pb.h"
 
+#include <algorithm>
 #include <set>
 #include <chrono>
+#include <random>
 
 #include <uv.h>
 #include <iostream>
@@ -275,6 +278,60 @@ static loom::pb::comm::Plan make_request_plan(Server &server)
    return plan;
 }
 
+/* make_random_plan
+
+   Layers of tasks, each task in a layer has random inputs from the previous layer
+   and random resource request (0-3 cpus)
+*/
+static loom::pb::comm::Plan make_random_plan(Server &server, size_t n_layers, size_t width,
+                                             size_t max_inputs, unsigned seed)
+{
+   using namespace loom::pb::comm;
+   std::mt19937 rnd(seed);
+   Plan plan;
+   plan.set_id_base(0);
+   add_cpu_request(server, plan, 1); // 0
+   add_cpu_request(server, plan, 2); // 1
+   add_cpu_request(server, plan, 3); // 2
+
+   for (size_t i = 0; i < width; i++) {
+      new_task(plan, 0);
+   }
+   for (size_t l = 1; l < n_layers; l++) {
+      for (size_t i = 0; i < width; i++) {
+         Task *t = new_task(plan, static_cast<int>(rnd() % 4) - 1);
+         size_t n_inputs = 1 + rnd() % max_inputs;
+         for (size_t j = 0; j < n_inputs; j++) {
+            t->add_input_ids((l - 1) * width + rnd() % width);
+         }
+      }
+   }
+   return plan;
+}
+
+/* make_chain_plan
+
+   n0 -> n1 -> ... -> n(length - 1)      n(length) ... n(length + n_flat - 1)
+
+*/
+static loom::pb::comm::Plan make_chain_plan(Server &server, size_t length, size_t n_flat)
+{
+   using namespace loom::pb::comm;
+   Plan plan;
+   plan.set_id_base(0);
+   add_cpu_request(server, plan, 1);
+
+   new_task(plan, 0);
+   for (size_t i = 1; i < length; i++) {
+      Task *t = new_task(plan, 0);
+      t->add_input_ids(i - 1);
+   }
+   for (size_t i = 0; i < n_flat; i++) {
+      new_task(plan, 0);
+   }
+   return plan;
+}
+
 std::vector<loom::base::Id> range(size_t limit)
 {
     std::vector<loom::base::Id> result;
@@ -323,6 +380,25 @@ static void add_plan(ComputationState &s, const loom::pb::comm::Plan &plan) {
     assert(to_load.empty());
 }
 
+/** Adds plan with tasks without consumers marked as results,
+ *  so all tasks are planned and nexts of all nodes are set */
+static void add_wired_plan(ComputationState &s, loom::pb::comm::Plan plan) {
+    std::vector<bool> has_next(plan.tasks_size(), false);
+    for (auto &t : plan.tasks()) {
+        for (auto id : t.input_ids()) {
+            has_next[id - plan.id_base()] = true;
+        }
+    }
+    for (int i = 0; i < plan.tasks_size(); i++) {
+        if (!has_next[i]) {
+            plan.mutable_tasks(i)->set_result(true);
+        }
+    }
+    std::vector<TaskNode*> to_load;
+    s.add_plan(plan, false, to_load);
+    assert(to_load.empty());
+}
+
 TEST_CASE("basic-plan", "[scheduling]") {
    Server server(NULL, 0);
    ComputationState s(server);
@@ -699,7 +775,8 @@ TEST_CASE("request-plan", "[scheduling]") {
 TEST_CASE("continuation2", "[scheduling]") {
    Server server(NULL, 0);
    ComputationState s(server);
-   add_plan(s, make_plan2(server));
+   // Heuristics of continuation follow nexts, that are set only for planned tasks
+   add_wired_plan(s, make_plan2(server));
 
    /*SECTION("Stick together") {
        auto w1 = simple_worker(server, "w1", 2);
@@ -725,7 +802,8 @@ TEST_CASE("continuation2", "[scheduling]") {
 TEST_CASE("continuation", "[scheduling]") {
    Server server(NULL, 0);
    ComputationState s(server);
-   add_plan(s, make_plan3(server));
+   // Heuristics of continuation follow nexts, that are set only for planned tasks
+   add_wired_plan(s, make_plan3(server));
 
    SECTION("Stick together - inputs dominant") {
        auto w1 = simple_worker(server, "w1", 2);
@@ -816,6 +894,693 @@ TEST_CASE("continuation", "[scheduling]") {
 }
 
 
+/* schedule_reference() runs the selection loop of the original schedule()
+   (a linear scan over all units in every step), changed only to break ties
+   of scores by task ids. Candidates and scores are computed by the code
+   shared with schedule(), so the check shows that the heap selection gives
+   the same assignments as the original loop; it does not cover changes of
+   the scoring itself.
+   Rows are then scored by threads parallel_runs times; every run has to
+   take the threaded path and give the same result as the serial one. */
+static void check_same_as_reference(ComputationState &s, int parallel_runs=1)
+{
+   TaskDistribution d1 = schedule(s);
+   TaskDistribution d2 = schedule_reference(s);
+   REQUIRE(d1 == d2);
+
+   SchedulerConfig config;
+   config.n_threads = 4;
+   config.parallel_limit = 1;
+   for (int i = 0; i < parallel_runs; i++) {
+      LocalityScheduler parallel_scheduler(s, config);
+      REQUIRE(!parallel_scheduler.has_work_pool());
+      TaskDistribution d3 = parallel_scheduler.schedule();
+      REQUIRE(parallel_scheduler.has_work_pool());
+      REQUIRE(d1 == d3);
+      size_t n_rows = parallel_scheduler.get_n_recomputed();
+
+      // All rows are scored again by the existing pool
+      parallel_scheduler.invalidate_all();
+      TaskDistribution d4 = parallel_scheduler.schedule();
+      REQUIRE(parallel_scheduler.get_n_recomputed() == n_rows);
+      REQUIRE(d1 == d4);
+   }
+}
+
+TEST_CASE("workpool", "[scheduling]") {
+   WorkPool pool(4);
+   REQUIRE(pool.get_n_threads() == 4);
+   for (size_t size = 0; size < 300; size += 7) {
+      std::vector<int> counts(size, 0);
+      pool.parallel_for(size, 3, [&counts](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; i++) {
+            counts[i]++;
+         }
+      });
+      for (int c : counts) {
+         REQUIRE(c == 1);
+      }
+   }
+}
+
+TEST_CASE("heap-vs-reference", "[scheduling]") {
+   SECTION("Plan3") {
+       Server server(NULL, 0);
+       ComputationState s(server);
+       add_wired_plan(s, make_plan3(server));
+       auto w1 = simple_worker(server, "w1", 2);
+       auto w2 = simple_worker(server, "w2", 2);
+       auto w3 = simple_worker(server, "w3", 0);
+
+       finish(s, 0, 800 << 20, 0, w1);
+       finish(s, 1, 30 << 20, 0, w2);
+       finish(s, 2, 800 << 20, 0, w3);
+       s.test_ready_nodes({3, 4, 5, 6});
+       check_same_as_reference(s);
+   }
+
+   SECTION("Request plan") {
+       Server server(NULL, 0);
+       ComputationState s(server);
+       add_wired_plan(s, make_request_plan(server));
+       simple_worker(server, "w1", 5);
+       simple_worker(server, "w2", 1);
+       simple_worker(server, "w3", 3);
+       s.test_ready_nodes(range(8));
+       check_same_as_reference(s);
+   }
+
+   SECTION("Big plan") {
+       const size_t BIG_PLAN_SIZE = 20000;
+       const size_t BIG_PLAN_WORKERS = 8;
+
+       Server server(NULL, 0);
+       ComputationState s(server);
+       add_wired_plan(s, make_big_plan(server, BIG_PLAN_SIZE));
+
+       std::vector<WorkerConnection*> ws;
+       for (size_t i = 0; i < BIG_PLAN_WORKERS; i++) {
+          ws.push_back(simple_worker(server, std::string("w") + std::to_string(i), 1 + i % 3));
+       }
+       std::vector<loom::base::Id> ready;
+       for (size_t i = 0; i < BIG_PLAN_SIZE; i++) {
+          finish(s, i, 10 + (i * 7919) % 1000, 0, ws[i % BIG_PLAN_WORKERS]);
+          ready.push_back(i + BIG_PLAN_SIZE);
+       }
+       s.test_ready_nodes(ready);
+       check_same_as_reference(s, 3);
+   }
+
+   SECTION("Random plans") {
+       const size_t WIDTH = 300;
+       for (unsigned seed = 1; seed <= 10; seed++) {
+          std::mt19937 rnd(seed);
+          Server server(NULL, 0);
+          ComputationState s(server);
+          add_wired_plan(s, make_random_plan(server, 3, WIDTH, 4, seed));
+
+          std::vector<WorkerConnection*> ws;
+          size_t n_workers = 2 + rnd() % 10;
+          for (size_t i = 0; i < n_workers; i++) {
+             ws.push_back(simple_worker(server, std::string("w") + std::to_string(i), rnd() % 8));
+          }
+
+          std::vector<loom::base::Id> ready;
+          for (size_t i = 0; i < WIDTH; i++) {
+             size_t size = (rnd() % 100) << (rnd() % 20);
+             finish(s, i, size, 0, ws[rnd() % n_workers]);
+             if (rnd() % 4 == 0) { // Some objects are replicated
+                finish(s, i, size, 0, ws[rnd() % n_workers]);
+             }
+             ready.push_back(WIDTH + i);
+          }
+          s.test_ready_nodes(ready);
+          check_same_as_reference(s, 3);
+       }
+   }
+}
+
+TEST_CASE("persistent-scheduler", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   add_wired_plan(s, make_plan3(server));
+   auto w1 = simple_worker(server, "w1", 2);
+   auto w2 = simple_worker(server, "w2", 2);
+   LocalityScheduler scheduler(s);
+
+   finish(s, 0, 10 << 20, 0, w1);
+   finish(s, 1, 100 << 20, 0, w2);
+   finish(s, 2, 60 << 20, 0, w1);
+   s.test_ready_nodes({3, 4});
+
+   // All cpus are busy; rows are computed but nothing is scheduled
+   w1->remove_free_cpus(2);
+   w2->remove_free_cpus(2);
+   REQUIRE(scheduler.schedule().empty());
+   REQUIRE(scheduler.get_n_rows() == 2);
+   // Small rounds do not start threads
+   REQUIRE(!scheduler.has_work_pool());
+
+   w1->add_free_cpus(1);
+   w2->add_free_cpus(1);
+
+   SECTION("Without change") {
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w2] == nodes(s, {4})));
+      REQUIRE(d == schedule(s));
+   }
+
+   SECTION("Transfer invalidates rows") {
+      s.get_node(1).set_worker_status(w1, TaskStatus::TRANSFER);
+      scheduler.data_changed(s.get_node(1));
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w1] == nodes(s, {4})));
+      REQUIRE(d == schedule(s));
+   }
+
+   SECTION("Blocked worker keeps rows") {
+      // Blocked by a residual task that waits for its checkpoint
+      w2->change_residual_tasks(2);
+      w2->residual_task_finished(100, false, true);
+      REQUIRE(w2->is_blocked());
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE(d[w2].empty());
+      REQUIRE(d[w1].size() == 1);
+      REQUIRE(scheduler.get_n_recomputed() == 0);
+
+      w2->change_residual_tasks(-1);
+      REQUIRE(!w2->is_blocked());
+      w1->add_free_cpus(1);
+      d = scheduler.schedule();
+      // Only the row of the task scheduled in the previous round (and still
+      // pending in the state) is new
+      REQUIRE(scheduler.get_n_recomputed() == 1);
+      REQUIRE(d == schedule(s));
+   }
+
+   SECTION("Worker join") {
+      auto w3 = simple_worker(server, "w3", 2);
+      finish(s, 1, 100 << 20, 0, w3);
+      finish(s, 2, 60 << 20, 0, w3);
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w3] == nodes(s, {4})));
+      REQUIRE(d == schedule(s));
+   }
+
+   REQUIRE(scheduler.get_n_rows() == 0);
+}
+
+TEST_CASE("ranks", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   const int64_t d = Estimator::DEFAULT_DURATION;
+
+   SECTION("Plan3") {
+      add_wired_plan(s, make_plan3(server));
+      REQUIRE(s.get_node(0).get_rank() == 3 * d);
+      REQUIRE(s.get_node(2).get_rank() == 3 * d);
+      REQUIRE(s.get_node(4).get_rank() == 2 * d);
+      REQUIRE(s.get_node(8).get_rank() == d);
+   }
+
+   SECTION("Propagation from next plan") {
+      add_wired_plan(s, make_chain_plan(server, 2, 0));
+      REQUIRE(s.get_node(0).get_rank() == 2 * d);
+
+      using namespace loom::pb::comm;
+      Plan plan;
+      plan.set_id_base(2);
+      add_cpu_request(server, plan, 1);
+      Task *t1 = new_task(plan, 0);
+      t1->add_input_ids(1);
+      Task *t2 = new_task(plan, 0);
+      t2->add_input_ids(2);
+      t2->set_result(true);
+      std::vector<TaskNode*> to_load;
+      s.add_plan(plan, false, to_load);
+
+      REQUIRE(s.get_node(3).get_rank() == d);
+      REQUIRE(s.get_node(1).get_rank() == 3 * d);
+      REQUIRE(s.get_node(0).get_rank() == 4 * d);
+   }
+
+   SECTION("Long chain goes first") {
+      add_wired_plan(s, make_chain_plan(server, 10, 300));
+      auto w1 = simple_worker(server, "w1", 1);
+      std::vector<loom::base::Id> ready;
+      ready.push_back(0);
+      for (size_t i = 0; i < 300; i++) {
+         ready.push_back(i + 10);
+      }
+      s.test_ready_nodes(ready);
+      TaskDistribution d = schedule(s);
+      // Worker is overbooked, but the head of the chain has to be selected first
+      REQUIRE(!d[w1].empty());
+      REQUIRE(d[w1][0] == &s.get_node(0));
+   }
+}
+
+static std::vector<loom::base::Id> ready_ids(const ComputationState &s)
+{
+   std::vector<loom::base::Id> result;
+   for (TaskNode *node : s.get_pending_tasks()) {
+      result.push_back(node->get_id());
+   }
+   return result;
+}
+
+TEST_CASE("ready-queue", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   auto w1 = simple_worker(server, "w1", 1);
+
+   // Head of the chain has the highest rank, flat tasks are ordered by ids
+   add_wired_plan(s, make_chain_plan(server, 3, 3));
+   REQUIRE((ready_ids(s) == std::vector<loom::base::Id>{0, 3, 4, 5}));
+
+   // Rank of a queued node is raised by a new plan
+   using namespace loom::pb::comm;
+   Plan plan;
+   plan.set_id_base(6);
+   add_cpu_request(server, plan, 1);
+   new_task(plan, 0)->add_input_ids(5);
+   Task *t = new_task(plan, 0);
+   t->add_input_ids(6);
+   t->add_input_ids(4);
+   t->set_result(true);
+   std::vector<TaskNode*> to_load;
+   s.add_plan(plan, false, to_load);
+   REQUIRE(s.get_node(5).get_rank() == s.get_node(0).get_rank());
+   REQUIRE((ready_ids(s) == std::vector<loom::base::Id>{0, 5, 4, 3}));
+
+   s.activate_pending_node(s.get_node(5), w1);
+   REQUIRE((ready_ids(s) == std::vector<loom::base::Id>{0, 4, 3}));
+
+   SECTION("FIFO takes the top of the queue") {
+      FifoScheduler scheduler(s);
+      simple_worker(server, "w2", 2);
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE(d.size() == 1);
+      REQUIRE((d.begin()->second == nodes(s, {0, 4})));
+   }
+}
+
+TEST_CASE("estimator", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   Estimator &e = s.get_estimator();
+
+   REQUIRE(e.predict_duration(0) == Estimator::DEFAULT_DURATION);
+   REQUIRE(e.predict_size(0) == Estimator::DEFAULT_SIZE);
+
+   REQUIRE(e.add_sample(0, 1000, 400));
+   REQUIRE(e.predict_duration(0) == 1000);
+   REQUIRE(e.predict_size(0) == 400);
+
+   REQUIRE(!e.add_sample(0, 0, 0));
+   REQUIRE(e.predict_duration(0) == 750);
+   REQUIRE(e.predict_size(0) == 300);
+   REQUIRE(e.predict_duration(1) == Estimator::DEFAULT_DURATION);
+
+   SECTION("Ranks use predicted durations") {
+      add_wired_plan(s, make_plan3(server));
+      REQUIRE(s.get_node(8).get_rank() == 750);
+      REQUIRE(s.get_node(0).get_rank() == 3 * 750);
+   }
+
+   SECTION("Stale ranks are updated") {
+      add_wired_plan(s, make_plan3(server));
+      finish(s, 0, 10, 0, simple_worker(server, "w1", 1));
+      // Ranks were computed with 750, but the last reported prediction is 1000
+      REQUIRE(!e.add_sample(0, 0, 0)); // 562
+      REQUIRE(e.add_sample(0, 0, 0)); // 421
+      s.update_ranks();
+      REQUIRE(s.get_node(8).get_rank() == 421);
+      REQUIRE(s.get_node(1).get_rank() == 3 * 421);
+      // Ranks of computed nodes are kept
+      REQUIRE(s.get_node(0).get_rank() == 3 * 750);
+   }
+
+   SECTION("Running input uses predicted size") {
+      // n1 is running on w2; n2 should go to w2 where n1's (big) output
+      // is expected, because n4 needs both
+      e.add_sample(0, 0, 200 << 20);
+      add_wired_plan(s, make_plan3(server));
+      auto w1 = simple_worker(server, "w1", 2);
+      auto w2 = simple_worker(server, "w2", 2);
+      s.get_node(1).set_as_running(w2);
+      s.test_ready_nodes({2});
+      TaskDistribution d = schedule(s);
+      REQUIRE(d[w1].empty());
+      REQUIRE((d[w2] == nodes(s, {2})));
+   }
+}
+
+TEST_CASE("scheduler-config", "[scheduling]") {
+   SchedulerConfig config;
+   REQUIRE(config.set("bonus_per_next=100"));
+   REQUIRE(config.bonus_per_next == 100);
+   REQUIRE(config.set("overbooking_limit=0"));
+   REQUIRE(config.overbooking_limit == 0);
+   REQUIRE(!config.set("bonus_per_next"));
+   REQUIRE(!config.set("bonus_per_next=abc"));
+   REQUIRE(!config.set("bonus_per_next=-1"));
+   REQUIRE(!config.set("xxx=1"));
+   REQUIRE(!config.set("transfer_bandwidth=0"));
+   REQUIRE(config.to_string().find("bonus_per_next=100") != std::string::npos);
+
+   Server server(NULL, 0);
+   ComputationState s(server);
+   REQUIRE(Scheduler::create("locality", s, config));
+   REQUIRE(Scheduler::create("fifo", s, config));
+   REQUIRE(Scheduler::create("heft", s, config));
+   REQUIRE(!Scheduler::create("xxx", s, config));
+}
+
+TEST_CASE("fifo-scheduler", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   add_plan(s, make_plan3(server));
+   FifoScheduler scheduler(s);
+
+   auto w1 = simple_worker(server, "w1", 1);
+   auto w2 = simple_worker(server, "w2", 2);
+
+   SECTION("Fill free cpus in order of ids") {
+      s.test_ready_nodes({2, 0, 1, 5, 6});
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w2] == nodes(s, {0, 2})));
+      REQUIRE((d[w1] == nodes(s, {1})));
+   }
+
+   SECTION("Data placement is ignored") {
+      finish(s, 0, 100 << 20, 0, w1);
+      s.test_ready_nodes({3});
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w2] == nodes(s, {3})));
+   }
+}
+
+TEST_CASE("fifo-scheduler-strict", "[scheduling]") {
+   using namespace loom::pb::comm;
+   Server server(NULL, 0);
+   ComputationState s(server);
+
+   Plan plan;
+   plan.set_id_base(0);
+   add_cpu_request(server, plan, 1);
+   add_cpu_request(server, plan, 2);
+   add_cpu_request(server, plan, 8);
+   new_task(plan, 2); // n0
+   new_task(plan, 0); // n1
+   new_task(plan, 1); // n2
+   new_task(plan, 0); // n3
+   add_plan(s, plan);
+   FifoScheduler scheduler(s);
+
+   auto w1 = simple_worker(server, "w1", 1);
+   auto w2 = simple_worker(server, "w2", 2);
+   w2->remove_free_cpus(1);
+
+   // n0 never fits and is skipped; n2 does not fit now, so n3 waits for it
+   s.test_ready_nodes({0, 1, 2, 3});
+   TaskDistribution d = scheduler.schedule();
+   REQUIRE((d[w1] == nodes(s, {1})));
+   REQUIRE(d[w2].empty());
+}
+
+TEST_CASE("heft-scheduler", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   add_plan(s, make_plan3(server));
+   HeftScheduler scheduler(s);
+
+   auto w1 = simple_worker(server, "w1", 2);
+   auto w2 = simple_worker(server, "w2", 2);
+
+   finish(s, 0, 100 << 20, 0, w1);
+   finish(s, 1, 10 << 20, 0, w2);
+   finish(s, 2, 10 << 20, 0, w2);
+
+   SECTION("Minimal transfers") {
+      // n3 (n0) -> w1, n4 (n1, n2) -> w2, n5 (n0, n1) -> w1
+      s.test_ready_nodes({3, 4, 5});
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w1] == nodes(s, {3, 5})));
+      REQUIRE((d[w2] == nodes(s, {4})));
+   }
+
+   SECTION("Planned transfers delay worker") {
+      // n5 (n0, n1) does not fit into w1 with n3, so it goes to w2
+      // with a long transfer of n0; then n6 (n2) is faster on empty w3
+      auto w3 = simple_worker(server, "w3", 2);
+      w1->remove_free_cpus(1);
+      s.test_ready_nodes({3, 5, 6});
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE((d[w1] == nodes(s, {3})));
+      REQUIRE((d[w2] == nodes(s, {5})));
+      REQUIRE((d[w3] == nodes(s, {6})));
+   }
+
+   SECTION("Running work delays worker") {
+      // n5 (n0, n1) would go to w1 for n0, but w1 is busy with n3
+      // for 10 s, so the transfer of n0 to w2 (1 s) finishes earlier
+      s.get_node(3).set_predicted_duration(10000);
+      s.get_node(3).set_as_running(w1);
+      REQUIRE(w1->get_running_work() == 10000);
+      s.test_ready_nodes({5});
+      TaskDistribution d = scheduler.schedule();
+      REQUIRE(d[w1].empty());
+      REQUIRE((d[w2] == nodes(s, {5})));
+   }
+}
+
+TEST_CASE("node-blocks", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+
+   add_plan(s, make_chain_plan(server, 2, 0));
+
+   using namespace loom::pb::comm;
+   Plan plan;
+   plan.set_id_base(10);
+   add_cpu_request(server, plan, 1);
+   Task *t1 = new_task(plan, 0);
+   t1->add_input_ids(1);
+   t1->set_config("abc");
+   t1->set_checkpoint_path("/tmp/x");
+   Task *t2 = new_task(plan, 0);
+   t2->add_input_ids(10);
+   t2->add_input_ids(10);
+   t2->add_input_ids(0);
+   t2->set_result(true);
+   std::vector<TaskNode*> to_load;
+   s.add_plan(plan, false, to_load);
+
+   REQUIRE(s.get_node_ptr(2) == nullptr);
+   REQUIRE(s.get_node_ptr(9) == nullptr);
+   REQUIRE(s.get_node_ptr(12) == nullptr);
+
+   const TaskNode &n10 = s.get_node(10);
+   REQUIRE(n10.get_task_def().config.str() == "abc");
+   REQUIRE(n10.get_task_def().checkpoint_path.str() == "/tmp/x");
+   REQUIRE(s.get_node(11).get_task_def().config.empty());
+   REQUIRE(s.get_node(11).get_inputs().size() == 3);
+   REQUIRE(s.get_node(11).get_inputs()[2] == &s.get_node(0));
+   REQUIRE(n10.get_nexts().size() == 2);
+   REQUIRE(s.get_node(0).get_nexts().size() == 2);
+
+   TaskNode &n11 = s.get_node(11);
+   REQUIRE(!s.get_node(10).next_finished(n11, 1));
+   REQUIRE(s.get_node(10).next_finished(n11, 0));
+   REQUIRE(!s.get_node(0).next_finished(n11, 2));
+   REQUIRE(s.get_node(0).get_nexts().size() == 1);
+   REQUIRE(s.get_node(0).get_nexts()[0] == &s.get_node(1));
+
+   s.remove_node(s.get_node(1));
+   REQUIRE(s.get_node_ptr(1) == nullptr);
+   REQUIRE(s.get_node_ptr(0) != nullptr);
+   s.remove_node(s.get_node(0));
+   REQUIRE(s.get_node_ptr(0) == nullptr);
+   REQUIRE(s.get_node_ptr(10) != nullptr);
+   s.clear_all();
+   REQUIRE(s.get_node_ptr(10) == nullptr);
+}
+
+TEST_CASE("node-nexts", "[scheduling]") {
+   using namespace loom::pb::comm;
+   Server server(NULL, 0);
+   ComputationState s(server);
+   std::vector<TaskNode*> to_load;
+
+   // n0 feeds n1 .. n100, every third of them uses n0 twice
+   Plan plan;
+   plan.set_id_base(0);
+   add_cpu_request(server, plan, 1);
+   new_task(plan, 0);
+   for (int i = 1; i <= 100; i++) {
+      Task *t = new_task(plan, 0);
+      t->add_input_ids(0);
+      if (i % 3 == 0) {
+         t->add_input_ids(0);
+      }
+      t->set_result(true);
+   }
+   s.add_plan(plan, false, to_load);
+
+   // Nexts from a later plan move nexts of n0 out of the flat array
+   Plan plan2;
+   plan2.set_id_base(200);
+   add_cpu_request(server, plan2, 1);
+   for (int i = 0; i < 10; i++) {
+      Task *t = new_task(plan2, 0);
+      t->add_input_ids(i % 2 == 0 ? 0 : 1);
+      t->add_input_ids(0);
+      t->set_result(true);
+   }
+   s.add_plan(plan2, false, to_load);
+
+   TaskNode &n0 = s.get_node(0);
+   std::multiset<TaskNode*> expected;
+   std::vector<std::pair<TaskNode*, uint32_t>> edges;
+   s.foreach_node([&](TaskNode &node) {
+      const NodeSpan &inputs = node.get_inputs();
+      for (uint32_t i = 0; i < inputs.size(); i++) {
+         if (inputs[i] == &n0) {
+            expected.insert(&node);
+            edges.push_back(std::make_pair(&node, i));
+         }
+      }
+   });
+   REQUIRE(edges.size() == 100 + 33 + 15);
+   REQUIRE(n0.get_nexts().size() == edges.size());
+
+   // Nexts finish in any order and the rest stays consistent
+   std::mt19937 rnd(1);
+   std::shuffle(edges.begin(), edges.end(), rnd);
+   for (size_t i = 0; i < edges.size(); i++) {
+      bool last = n0.next_finished(*edges[i].first, edges[i].second);
+      REQUIRE(last == (i + 1 == edges.size()));
+      expected.erase(expected.find(edges[i].first));
+      std::multiset<TaskNode*> nexts(n0.get_nexts().begin(), n0.get_nexts().end());
+      REQUIRE(nexts == expected);
+   }
+}
+
+TEST_CASE("worker-status-set", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+
+   std::vector<WorkerConnection*> ws;
+   for (int i = 0; i < 5; i++) {
+      ws.push_back(simple_worker(server, "w" + std::to_string(i)));
+      REQUIRE(ws[i]->get_worker_index() == i);
+   }
+
+   add_plan(s, make_chain_plan(server, 1, 0));
+   TaskNode &node = s.get_node(0);
+   REQUIRE(node.get_workers().empty());
+   REQUIRE(node.get_random_owner() == nullptr);
+
+   node.set_worker_status(ws[3], TaskStatus::OWNER);
+   node.set_worker_status(ws[1], TaskStatus::TRANSFER);
+   REQUIRE(node.get_workers().size() == 2);
+   REQUIRE(node.get_worker_status(ws[3]) == TaskStatus::OWNER);
+   REQUIRE(node.get_worker_status(ws[1]) == TaskStatus::TRANSFER);
+   REQUIRE(node.get_worker_status(ws[0]) == TaskStatus::NONE);
+   REQUIRE(node.get_random_owner() == ws[3]);
+   REQUIRE(node.is_active());
+
+   // Inline entries are exhausted
+   node.set_worker_status(ws[0], TaskStatus::OWNER);
+   node.set_worker_status(ws[4], TaskStatus::RUNNING);
+   node.set_worker_status(ws[2], TaskStatus::LOADING);
+   REQUIRE(node.get_workers().size() == 5);
+   node.set_as_transferred(ws[1]);
+   for (int i = 0; i < 5; i++) {
+      REQUIRE(node.get_workers().get(i) == node.get_worker_status(ws[i]));
+   }
+   REQUIRE(node.get_worker_status(ws[1]) == TaskStatus::OWNER);
+
+   int n_owners = 0;
+   node.foreach_owner([&n_owners](WorkerConnection *wc) { n_owners++; });
+   REQUIRE(n_owners == 3);
+
+   node.reset_owners();
+   REQUIRE(node.get_workers().size() == 2);
+   REQUIRE(node.get_worker_status(ws[4]) == TaskStatus::RUNNING);
+   REQUIRE(node.get_worker_status(ws[2]) == TaskStatus::LOADING);
+
+   node.set_worker_status(ws[4], TaskStatus::NONE);
+   node.set_worker_status(ws[3], TaskStatus::NONE);
+   REQUIRE(node.get_workers().size() == 1);
+   REQUIRE(!node.is_active());
+   s.clear_all();
+
+   // Index of a removed worker is reused
+   server.remove_worker_connection(*ws[1]);
+   WorkerConnection *w5 = simple_worker(server, "w5");
+   REQUIRE(w5->get_worker_index() == 1);
+   REQUIRE(simple_worker(server, "w6")->get_worker_index() == 5);
+}
+
+TEST_CASE("select-owner", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+
+   auto a1 = simple_worker(server, "10.0.0.1:1000");
+   auto a2 = simple_worker(server, "10.0.0.1:1001");
+   auto b1 = simple_worker(server, "10.0.0.2:1000");
+   auto c1 = simple_worker(server, "10.0.0.3:1000");
+   auto d1 = simple_worker(server, "10.0.0.4:1000");
+   REQUIRE(a1->get_host() == "10.0.0.1");
+   c1->set_rack("r1");
+   d1->set_rack("r1");
+
+   add_plan(s, make_chain_plan(server, 1, 0));
+   TaskNode &node = s.get_node(0);
+   REQUIRE(node.select_owner(a1) == nullptr);
+
+   node.set_worker_status(b1, TaskStatus::OWNER);
+   node.set_worker_status(c1, TaskStatus::OWNER);
+   node.set_worker_status(a2, TaskStatus::TRANSFER);
+
+   // The least loaded owner
+   b1->change_outgoing_bytes(100);
+   REQUIRE(node.select_owner(a1) == c1);
+   REQUIRE(node.select_owner(nullptr) == c1);
+   c1->change_outgoing_bytes(200);
+   REQUIRE(node.select_owner(a1) == b1);
+   REQUIRE(node.select_owner(a1, [b1](WorkerConnection *wc) { return wc == b1; }) == c1);
+
+   // Owners in the same rack, then on the same host go first
+   REQUIRE(node.select_owner(d1) == c1);
+   node.set_as_transferred(a2);
+   a2->change_outgoing_bytes(1000);
+   REQUIRE(node.select_owner(a1) == a2);
+   REQUIRE(node.select_owner(d1) == c1);
+   REQUIRE(node.select_owner(nullptr) == b1);
+}
+
+TEST_CASE("worker-command-batch", "[scheduling]") {
+   Server server(NULL, 0);
+   ComputationState s(server);
+   add_plan(s, make_chain_plan(server, 2, 0));
+
+   auto w1 = simple_worker(server, "w1");
+   REQUIRE(w1->get_n_queued_commands() == 0);
+
+   w1->send_task(s.get_node(0));
+   w1->send_data(0, "w2");
+   w1->remove_data(0);
+   REQUIRE(w1->get_n_queued_commands() == 3);
+
+   w1->flush_commands();
+   REQUIRE(w1->get_n_queued_commands() == 0);
+   w1->remove_data(1);
+   REQUIRE(w1->get_n_queued_commands() == 1);
+}
+
 TEST_CASE("benchmark1", "[benchmark][!hide]") {
     using namespace std::chrono;
     const size_t CPUS = 24;
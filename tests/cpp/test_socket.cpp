@@ -0,0 +1,341 @@
+#include "catch/catch.hpp"
+
+#include "libloom/socket.h"
+#include "libloom/listener.h"
+#include "libloom/sendbuffer.h"
+#include "libloom/compat.h"
+
+#include <uv.h>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace loom::base;
+
+static std::unique_ptr<SendBufferItem> make_message(size_t size, char value)
+{
+   auto item = std::make_unique<MemItemWithSz>(size);
+   memset(item->get_ptr(), value, size);
+   return std::move(item);
+}
+
+static bool check_message(const char *buffer, size_t size, char value)
+{
+   for (size_t i = 0; i < size; i++) {
+      if (buffer[i] != value) {
+         return false;
+      }
+   }
+   return true;
+}
+
+TEST_CASE("socket-framing", "[socket]") {
+   const size_t N_SMALL = 5000;
+   const size_t BIG_SIZE = 3 << 20;
+   const size_t STREAM_SIZE = 20 << 20;
+
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   Listener listener;
+   Socket sender(&loop);
+   std::unique_ptr<Socket> receiver;
+
+   size_t n_small = 0;
+   size_t n_invalid = 0;
+   bool big_received = false;
+   size_t stream_received = 0;
+   bool finished = false;
+
+   // Destination of the stream when it is received directly
+   bool direct = false;
+   std::unique_ptr<char[]> target;
+   size_t n_direct_chunks = 0;
+
+   SECTION("Stream through the read buffer") {
+      direct = false;
+   }
+
+   SECTION("Stream directly to the target") {
+      direct = true;
+   }
+
+   listener.start(&loop, 0, [&]() {
+      receiver = std::make_unique<Socket>(&loop);
+      listener.accept(*receiver);
+      Socket *r = receiver.get();
+      r->set_on_message([&, r](const char *buffer, size_t size) {
+         if (n_small < N_SMALL) {
+            if (size != n_small % 100 || !check_message(buffer, size, n_small % 128)) {
+               n_invalid++;
+            }
+            n_small++;
+         } else if (!big_received) {
+            big_received = size == BIG_SIZE && check_message(buffer, size, 'b');
+         } else if (size == 1 && buffer[0] == 's') {
+            r->set_stream_mode(true);
+         } else {
+            finished = size == 1 && buffer[0] == 'e';
+            r->close();
+            sender.close();
+            listener.close();
+         }
+      });
+      r->set_on_stream_target([&](size_t size) -> char* {
+         if (!direct) {
+            return nullptr;
+         }
+         target = std::make_unique<char[]>(size);
+         return target.get();
+      });
+      r->set_on_stream_data([&, r](const char *buffer, size_t size, size_t remaining) {
+         if (target && buffer == target.get() + stream_received) {
+            n_direct_chunks++;
+         }
+         for (size_t i = 0; i < size; i++) {
+            if (buffer[i] != static_cast<char>((stream_received + i) % 251)) {
+               n_invalid++;
+               break;
+            }
+         }
+         stream_received += size;
+         if (remaining == 0) {
+            r->set_stream_mode(false);
+         }
+      });
+      r->set_on_close([]() {});
+   });
+
+   sender.set_on_close([]() {});
+   sender.set_on_connect([&]() {
+      auto buffer = std::make_unique<SendBuffer>();
+      for (size_t i = 0; i < N_SMALL; i++) {
+         buffer->add(make_message(i % 100, i % 128));
+      }
+      buffer->add(make_message(BIG_SIZE, 'b'));
+      buffer->add(make_message(1, 's'));
+      buffer->add(std::make_unique<SizeBufferItem>(STREAM_SIZE));
+      auto data = std::make_unique<MemItem>(STREAM_SIZE);
+      for (size_t i = 0; i < STREAM_SIZE; i++) {
+         data->get_ptr()[i] = i % 251;
+      }
+      buffer->add(std::move(data));
+      buffer->add(make_message(1, 'e'));
+      sender.send(std::move(buffer));
+   });
+   sender.connect("127.0.0.1", listener.get_port());
+
+   uv_run(&loop, UV_RUN_DEFAULT);
+   receiver.reset();
+   uv_loop_close(&loop);
+
+   REQUIRE(n_small == N_SMALL);
+   REQUIRE(n_invalid == 0);
+   REQUIRE(big_received);
+   REQUIRE(stream_received == STREAM_SIZE);
+   REQUIRE(finished);
+   if (direct) {
+      REQUIRE(n_direct_chunks > 0);
+   } else {
+      REQUIRE(n_direct_chunks == 0);
+   }
+}
+
+TEST_CASE("socket-sendfile", "[socket]") {
+   const size_t FILE_SIZE = 10 << 20;
+
+   char filename[] = "/tmp/loom-test-sendfile-XXXXXX";
+   int fd = mkstemp(filename);
+   REQUIRE(fd >= 0);
+   std::unique_ptr<char[]> content = std::make_unique<char[]>(FILE_SIZE);
+   for (size_t i = 0; i < FILE_SIZE; i++) {
+      content[i] = i % 253;
+   }
+   REQUIRE(write(fd, content.get(), FILE_SIZE) == FILE_SIZE);
+   close(fd);
+
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   Listener listener;
+   Socket sender(&loop);
+   std::unique_ptr<Socket> receiver;
+   std::vector<std::string> messages;
+
+   listener.start(&loop, 0, [&]() {
+      receiver = std::make_unique<Socket>(&loop);
+      listener.accept(*receiver);
+      Socket *r = receiver.get();
+      r->set_on_message([&, r](const char *buffer, size_t size) {
+         messages.push_back(std::string(buffer, size));
+         if (messages.size() == 4) {
+            r->close();
+            sender.close();
+            listener.close();
+         }
+      });
+      r->set_on_close([]() {});
+   });
+
+   sender.set_on_close([]() {});
+   sender.set_on_connect([&]() {
+      auto buffer = std::make_unique<SendBuffer>();
+      buffer->add(make_message(1, 'a'));
+      sender.send(std::move(buffer));
+
+      // File is sent as a message; everything sent after it has to wait
+      buffer = std::make_unique<SendBuffer>();
+      buffer->add(std::make_unique<SizeBufferItem>(FILE_SIZE));
+      buffer->add(std::make_unique<FileItem>(filename, FILE_SIZE));
+      buffer->add(make_message(1, 'x'));
+      REQUIRE(buffer->has_file_items());
+      REQUIRE(buffer->get_data_size() == FILE_SIZE + sizeof(uint64_t) * 2 + 1);
+      sender.send(std::move(buffer));
+
+      buffer = std::make_unique<SendBuffer>();
+      buffer->add(make_message(1, 'z'));
+      sender.send(std::move(buffer));
+   });
+   sender.connect("127.0.0.1", listener.get_port());
+
+   uv_run(&loop, UV_RUN_DEFAULT);
+   receiver.reset();
+   uv_loop_close(&loop);
+   unlink(filename);
+
+   REQUIRE(messages.size() == 4);
+   REQUIRE(messages[0] == "a");
+   REQUIRE(messages[1] == std::string(content.get(), FILE_SIZE));
+   REQUIRE(messages[2] == "x");
+   REQUIRE(messages[3] == "z");
+}
+
+TEST_CASE("socket-sendfile-stalled-peer", "[socket]") {
+   const size_t FILE_SIZE = 256 << 20;
+
+   char filename[] = "/tmp/loom-test-sendfile-XXXXXX";
+   int fd = mkstemp(filename);
+   REQUIRE(fd >= 0);
+   REQUIRE(ftruncate(fd, FILE_SIZE) == 0);
+   close(fd);
+
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   Listener listener;
+   std::unique_ptr<Socket> sender;
+   bool closed = false;
+
+   listener.start(&loop, 0, [&]() {
+      sender = std::make_unique<Socket>(&loop);
+      listener.accept(*sender);
+      sender->set_on_close([&]() {
+         closed = true;
+      });
+      auto buffer = std::make_unique<SendBuffer>();
+      buffer->add(std::make_unique<SizeBufferItem>(FILE_SIZE));
+      buffer->add(std::make_unique<FileItem>(filename, FILE_SIZE));
+      sender->send(std::move(buffer));
+      listener.close();
+   });
+
+   // The peer never reads
+   int peer = socket(AF_INET, SOCK_STREAM, 0);
+   REQUIRE(peer >= 0);
+   sockaddr_in addr = {};
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(listener.get_port());
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   REQUIRE(connect(peer, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+   // Without a bounded wait in sendfile, close would never finish
+   uv_timer_t timer;
+   uv_timer_init(&loop, &timer);
+   timer.data = &sender;
+   uv_timer_start(&timer, [](uv_timer_t *timer) {
+      auto *sender = static_cast<std::unique_ptr<Socket>*>(timer->data);
+      REQUIRE((*sender)->get_queued_bytes() > 0);
+      (*sender)->close();
+      uv_close(reinterpret_cast<uv_handle_t*>(timer), nullptr);
+   }, 300, 0);
+
+   uv_run(&loop, UV_RUN_DEFAULT);
+   sender.reset();
+   uv_loop_close(&loop);
+   close(peer);
+   unlink(filename);
+
+   REQUIRE(closed);
+}
+
+TEST_CASE("socket-watermarks", "[socket]") {
+   const size_t MESSAGE_SIZE = 4 << 20;
+   const size_t N_MESSAGES = 8;
+
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   Listener listener;
+   Socket sender(&loop);
+   std::unique_ptr<Socket> receiver;
+   size_t n_received = 0;
+   size_t n_sent = 0;
+   size_t n_drains = 0;
+   size_t max_queued = 0;
+
+   sender.set_watermarks(2 * MESSAGE_SIZE, MESSAGE_SIZE);
+
+   // Messages are sent only when the socket is not congested
+   auto send_messages = [&]() {
+      while (n_sent < N_MESSAGES && !sender.is_congested()) {
+         auto buffer = std::make_unique<SendBuffer>();
+         buffer->add(make_message(MESSAGE_SIZE, 'm'));
+         sender.send(std::move(buffer));
+         n_sent++;
+         max_queued = std::max(max_queued, sender.get_queued_bytes());
+      }
+   };
+
+   listener.start(&loop, 0, [&]() {
+      receiver = std::make_unique<Socket>(&loop);
+      listener.accept(*receiver);
+      Socket *r = receiver.get();
+      r->set_on_message([&, r](const char *buffer, size_t size) {
+         n_received++;
+         if (n_received == N_MESSAGES) {
+            r->close();
+            sender.close();
+            listener.close();
+         }
+      });
+      r->set_on_close([]() {});
+   });
+
+   sender.set_on_close([]() {});
+   sender.set_on_drain([&]() {
+      REQUIRE(sender.get_queued_bytes() <= MESSAGE_SIZE);
+      n_drains++;
+      send_messages();
+   });
+   sender.set_on_connect([&]() {
+      REQUIRE_FALSE(sender.is_congested());
+      send_messages();
+      // Writes are finished in the next loop iterations
+      REQUIRE(sender.is_congested());
+      REQUIRE(n_sent == 2);
+   });
+   sender.connect("127.0.0.1", listener.get_port());
+
+   uv_run(&loop, UV_RUN_DEFAULT);
+   receiver.reset();
+   uv_loop_close(&loop);
+
+   REQUIRE(n_received == N_MESSAGES);
+   REQUIRE(n_drains >= 1);
+   REQUIRE(max_queued <= 2 * (MESSAGE_SIZE + sizeof(uint64_t)));
+   REQUIRE(sender.get_queued_bytes() == 0);
+}
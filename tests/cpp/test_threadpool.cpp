@@ -0,0 +1,92 @@
+#include "catch/catch.hpp"
+
+#include "libloomw/threadpool.h"
+
+#include <uv.h>
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace loom;
+
+struct PoolTestJob {
+   uv_work_t work;
+   std::thread::id loop_thread;
+   std::atomic<int> *n_running;
+   int max_running;
+   int cpu;
+   bool after_in_loop_thread;
+   bool finished;
+};
+
+static void pool_test_work(uv_work_t *req)
+{
+   PoolTestJob *job = static_cast<PoolTestJob*>(req->data);
+   int n = ++*job->n_running;
+   job->max_running = n;
+   usleep(20000);
+   job->cpu = sched_getcpu();
+   --*job->n_running;
+}
+
+static void pool_test_after_work(uv_work_t *req, int status)
+{
+   PoolTestJob *job = static_cast<PoolTestJob*>(req->data);
+   job->after_in_loop_thread = std::this_thread::get_id() == job->loop_thread;
+   job->finished = true;
+}
+
+TEST_CASE("thread-pool", "[threadpool]") {
+   const int N_JOBS = 12;
+
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   std::atomic<int> n_running(0);
+   std::vector<PoolTestJob> jobs(N_JOBS);
+
+   // Cpu 0 need not be available (taskset, cgroups)
+   cpu_set_t available;
+   REQUIRE(pthread_getaffinity_np(pthread_self(), sizeof(available), &available) == 0);
+   int pin_cpu = 0;
+   while (!CPU_ISSET(pin_cpu, &available)) {
+      pin_cpu++;
+   }
+
+   {
+      ThreadPool pool("test");
+      pool.init(&loop, 3, true);
+
+      for (auto &job : jobs) {
+         job.work.data = &job;
+         job.loop_thread = std::this_thread::get_id();
+         job.n_running = &n_running;
+         job.max_running = 0;
+         job.cpu = -1;
+         job.after_in_loop_thread = false;
+         job.finished = false;
+      }
+      for (int i = 0; i < N_JOBS; i++) {
+         // The first job is pinned to the first available cpu
+         std::vector<int> cpus;
+         if (i == 0) {
+            cpus.push_back(pin_cpu);
+         }
+         pool.queue_work(&jobs[i].work, pool_test_work, pool_test_after_work, cpus);
+      }
+      REQUIRE(pool.get_n_threads() == 3);
+
+      // The loop ends when all jobs are finished
+      uv_run(&loop, UV_RUN_DEFAULT);
+      pool.close();
+      uv_run(&loop, UV_RUN_DEFAULT);
+   }
+   REQUIRE(uv_loop_close(&loop) == 0);
+
+   for (auto &job : jobs) {
+      REQUIRE(job.finished);
+      REQUIRE(job.after_in_loop_thread);
+      REQUIRE(job.max_running <= 3);
+   }
+   REQUIRE(jobs[0].cpu == pin_cpu);
+}
@@ -0,0 +1,74 @@
+#include "catch/catch.hpp"
+
+#include "libloomw/transferqueue.h"
+
+#include <uv.h>
+#include <vector>
+
+using namespace loom;
+using namespace loom::base;
+
+struct StartedTransfer {
+   std::string address;
+   Id id;
+   TransferQueue::FinishFn finish;
+};
+
+TEST_CASE("transfer-queue-limits", "[transfers]") {
+   uv_loop_t loop;
+   uv_loop_init(&loop);
+
+   TransferQueue queue(&loop, 3, 2);
+   std::vector<StartedTransfer> started;
+   queue.set_start_fn([&](const std::string &address, Id id,
+                          const DataPtr &data, TransferQueue::FinishFn &&finish) {
+      started.push_back(StartedTransfer{address, id, std::move(finish)});
+   });
+
+   queue.add("a", 1, DataPtr(), 0);
+   queue.add("a", 2, DataPtr(), 10);
+   queue.add("a", 3, DataPtr(), 5);
+   queue.add("b", 4, DataPtr(), 1);
+   queue.add("b", 5, DataPtr(), 1);
+   queue.add("c", 6, DataPtr(), 100);
+
+   // Nothing is started before the loop runs
+   REQUIRE(started.empty());
+   REQUIRE(queue.get_n_waiting() == 6);
+
+   uv_run(&loop, UV_RUN_NOWAIT);
+
+   // Total limit is 3 and "a" may have only 2 transfers
+   REQUIRE(started.size() == 3);
+   REQUIRE(started[0].id == 6);
+   REQUIRE(started[1].id == 2);
+   REQUIRE(started[2].id == 3);
+   REQUIRE(queue.get_n_active() == 3);
+   REQUIRE(queue.get_n_waiting() == 3);
+
+   // Transfers are started again only in the next iteration
+   started[1].finish();
+   REQUIRE(started.size() == 3);
+   uv_run(&loop, UV_RUN_NOWAIT);
+   REQUIRE(started.size() == 4);
+   REQUIRE(started[3].id == 4); // "b" first, it has higher priority than id=1
+
+   started[0].finish();
+   started[2].finish();
+   uv_run(&loop, UV_RUN_NOWAIT);
+   REQUIRE(started.size() == 6);
+   REQUIRE(started[4].id == 5);
+   REQUIRE(started[5].id == 1);
+   REQUIRE(queue.get_n_waiting() == 0);
+
+   for (size_t i = 3; i < started.size(); i++) {
+      started[i].finish();
+   }
+   REQUIRE(queue.get_n_active() == 0);
+   uv_run(&loop, UV_RUN_NOWAIT);
+   REQUIRE(started.size() == 6);
+
+   queue.close();
+   uv_run(&loop, UV_RUN_DEFAULT);
+   REQUIRE(uv_loop_close(&loop) == 0);
+}